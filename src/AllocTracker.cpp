@@ -0,0 +1,155 @@
+#include "AllocTracker.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef MIDAS_TRACK_ALLOCS
+
+static const char* PHASE_NAMES[ALLOC_PHASES] = { "other", "input", "swap", "cascade", "draw", "present" };
+
+// Keeps the block size for delete; big enough to preserve malloc alignment
+static const size_t HEADER = 16;
+
+struct PhaseCounter
+{
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> bytes;
+};
+
+struct PhaseTotals
+{
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t maxCount;
+	uint64_t maxBytes;
+};
+
+static PhaseCounter s_frame[ALLOC_PHASES];
+static PhaseTotals s_session[ALLOC_PHASES];
+static std::atomic<uint64_t> s_count(0);
+static std::atomic<int64_t> s_live(0);
+static std::atomic<int64_t> s_peak(0);
+static uint64_t s_frames = 0;
+static uint64_t s_textureBytes = 0;
+static thread_local AllocPhase s_phase = ALLOC_OTHER;
+
+void* operator new(size_t size)
+{
+	char* block = static_cast<char*>(malloc(size + HEADER));
+	if (!block) throw std::bad_alloc();
+
+	*reinterpret_cast<size_t*>(block) = size;
+
+	PhaseCounter& counter = s_frame[s_phase];
+	counter.count.fetch_add(1, std::memory_order_relaxed);
+	counter.bytes.fetch_add(size, std::memory_order_relaxed);
+	s_count.fetch_add(1, std::memory_order_relaxed);
+
+	const int64_t live = s_live.fetch_add(int64_t(size), std::memory_order_relaxed) + int64_t(size);
+	int64_t peak = s_peak.load(std::memory_order_relaxed);
+	while (live > peak && !s_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+
+	return block + HEADER;
+}
+
+void operator delete(void* p) noexcept
+{
+	if (!p) return;
+
+	char* block = static_cast<char*>(p) - HEADER;
+	s_live.fetch_sub(int64_t(*reinterpret_cast<size_t*>(block)), std::memory_order_relaxed);
+	free(block);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+AllocScope::AllocScope(AllocPhase phase)
+	: m_prev(s_phase)
+{
+	s_phase = phase;
+}
+
+AllocScope::~AllocScope()
+{
+	s_phase = m_prev;
+}
+
+bool AllocTracker::Enabled()
+{
+	return true;
+}
+
+uint64_t AllocTracker::Count()
+{
+	return s_count.load(std::memory_order_relaxed);
+}
+
+void AllocTracker::EndFrame()
+{
+	for (int i = 0; i < ALLOC_PHASES; ++i)
+	{
+		const uint64_t count = s_frame[i].count.exchange(0, std::memory_order_relaxed);
+		const uint64_t bytes = s_frame[i].bytes.exchange(0, std::memory_order_relaxed);
+		PhaseTotals& totals = s_session[i];
+
+		totals.count += count;
+		totals.bytes += bytes;
+		if (count > totals.maxCount) totals.maxCount = count;
+		if (bytes > totals.maxBytes) totals.maxBytes = bytes;
+	}
+
+	++s_frames;
+}
+
+void AllocTracker::Report(const char* title)
+{
+	const double frames = double(s_frames ? s_frames : 1);
+
+	fprintf(stderr, "%s allocations over %llu frames, peak live %lld bytes, textures %llu bytes\n",
+			title, (unsigned long long)s_frames, (long long)s_peak.load(), (unsigned long long)s_textureBytes);
+
+	for (int i = 0; i < ALLOC_PHASES; ++i)
+	{
+		const PhaseTotals& totals = s_session[i];
+		if (!totals.count) continue;
+
+		fprintf(stderr, "  %-8s %llu allocs %llu bytes, per frame mean %.2f allocs %.0f bytes, max %llu allocs %llu bytes\n",
+				PHASE_NAMES[i], (unsigned long long)totals.count, (unsigned long long)totals.bytes,
+				double(totals.count) / frames, double(totals.bytes) / frames,
+				(unsigned long long)totals.maxCount, (unsigned long long)totals.maxBytes);
+	}
+}
+
+void AllocTracker::Reset()
+{
+	for (int i = 0; i < ALLOC_PHASES; ++i)
+	{
+		s_frame[i].count.store(0, std::memory_order_relaxed);
+		s_frame[i].bytes.store(0, std::memory_order_relaxed);
+		s_session[i] = PhaseTotals();
+	}
+
+	s_frames = 0;
+	s_peak.store(s_live.load());
+}
+
+void AllocTracker::AddTexture(uint64_t bytes)
+{
+	s_textureBytes += bytes;
+}
+
+#else
+
+bool AllocTracker::Enabled() { return false; }
+uint64_t AllocTracker::Count() { return 0; }
+void AllocTracker::EndFrame() { }
+void AllocTracker::Report(const char*) { }
+void AllocTracker::Reset() { }
+void AllocTracker::AddTexture(uint64_t) { }
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+enum AllocPhase
+{
+	ALLOC_OTHER,
+	ALLOC_INPUT,
+	ALLOC_SWAP,
+	ALLOC_CASCADE,
+	ALLOC_DRAW,
+	ALLOC_PRESENT,
+	ALLOC_PHASES
+};
+
+// Heap accounting by game phase. Built with MIDAS_TRACK_ALLOCS the global
+// operator new/delete are replaced to count allocations, bytes and live/peak
+// usage against the innermost AllocScope of the allocating thread; otherwise
+// everything here compiles to nothing. Needs no SDL, so the headless tools
+// can be built with it too.
+class AllocTracker
+{
+public:
+	static bool Enabled();
+
+	// Allocations made so far in all phases
+	static uint64_t Count();
+
+	// Folds the current frame into the session totals
+	static void EndFrame();
+
+	// Prints session totals and per-frame mean/max for each phase to stderr
+	static void Report(const char* title);
+	static void Reset();
+
+	// Texture memory is not on the heap, the caller estimates it from the size
+	static void AddTexture(uint64_t bytes);
+};
+
+#ifdef MIDAS_TRACK_ALLOCS
+
+class AllocScope
+{
+public:
+	explicit AllocScope(AllocPhase phase);
+	~AllocScope();
+
+private:
+	AllocPhase m_prev;
+};
+
+#else
+
+class AllocScope
+{
+public:
+	explicit AllocScope(AllocPhase) { }
+};
+
+#endif
@@ -3,21 +3,70 @@
 #include "Grid.h"
 
 #include <SDL.h>
+#include <algorithm>
+#include <cassert>
 
 const Uint32 AnimateSwap::DURATION = 500;
 const Uint32 AnimateScaling::DURATION = 500;
 const Uint32 AnimateSlide::STEP_DURATION = 150; 
 
+static const size_t ENTRY_CAPACITY = 256;
+static const size_t ARENA_ALIGN = 16;
+
+Animations::Animations()
+	: m_started(0)
+	, m_startTS(0)
+	, m_duration(0)
+	, m_animEvent(SDL_RegisterEvents(1))
+	, m_block(0)
+	, m_used(0)
+{
+	m_entries.reserve(ENTRY_CAPACITY);
+	m_blocks.push_back(new char[BLOCK_SIZE]);
+}
+
 Animations::~Animations()
 {
-	m_animEvent = SDL_RegisterEvents(1);
 	Cancel();
+
+	for (size_t i = 0; i < m_blocks.size(); ++i)
+		delete[] m_blocks[i];
 }
 
-void Animations::AddAnimation(std::auto_ptr<Animation> anim)
+void* Animations::Allocate(size_t size)
 {
-	const bool empty = m_animations.empty();
-	m_animations.push_back(anim.release());
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	assert(size <= BLOCK_SIZE);
+
+	if (m_used + size > BLOCK_SIZE)
+	{
+		if (++m_block == m_blocks.size())
+			m_blocks.push_back(new char[BLOCK_SIZE]);
+
+		m_used = 0;
+	}
+
+	void* p = m_blocks[m_block] + m_used;
+	m_used += size;
+	return p;
+}
+
+void Animations::AddAnimation(Animation* anim, Uint32 start)
+{
+	const bool empty = m_entries.empty();
+
+	if (empty)
+		m_startTS = SDL_GetTicks();
+
+	const Entry entry = { start, anim };
+	std::vector<Entry>::iterator it = std::upper_bound(m_entries.begin(), m_entries.end(), entry);
+
+	// Already due, Draw will not reach it through the cursor
+	if (size_t(it - m_entries.begin()) < m_started)
+		++m_started;
+
+	m_entries.insert(it, entry);
+	m_duration = std::max(m_duration, start + entry.anim->Duration());
 	
 	if (empty)
 	{
@@ -30,39 +79,41 @@ void Animations::AddAnimation(std::auto_ptr<Animation> anim)
 
 void Animations::Draw(SDL_Renderer* rend)
 {
-	std::list<Animation*>::iterator it = m_animations.begin();
+	const Uint32 elapsed = SDL_GetTicks() - m_startTS;
 
-	bool active = false;
+	while (m_started < m_entries.size() && m_entries[m_started].start <= elapsed)
+		++m_started;
 
-	while (it != m_animations.end())
+	// Finished animations keep drawing their last frame over the old cells
+	for (size_t i = 0; i < m_started; ++i)
 	{
-		bool completed = (*it)->Draw();
-		active = active || !completed;
-		++it;
+		Animation* anim = m_entries[i].anim;
+		anim->Draw(std::min(elapsed - m_entries[i].start, anim->Duration()));
 	}
 
-	if (!active)
-		Cancel();	
+	if (elapsed >= m_duration)
+		Cancel();
 }
 
 void Animations::Cancel()
 {
-	std::list<Animation*>::iterator it = m_animations.begin();
-		
-	while (it != m_animations.end())
-	{
-		delete *it;
-		it = m_animations.erase(it);
-	}
+	for (size_t i = 0; i < m_entries.size(); ++i)
+		m_entries[i].anim->~Animation();
+
+	// Blocks stay around for the next cascade
+	m_block = 0;
+	m_used = 0;
+
+	m_entries.clear();
+	m_started = 0;
+	m_duration = 0;
 }
 
-AnimateSwap::AnimateSwap(Grid& grid, int x1, int y1, int clr1, int x2, int y2, int clr2, bool wrong, Uint32 delay)
+AnimateSwap::AnimateSwap(Grid& grid, int x1, int y1, int clr1, int x2, int y2, int clr2, bool wrong)
 	: m_grid(grid)
 	, m_clr1(clr1)
 	, m_clr2(clr2)
 	, m_wrong(wrong)
-	, m_delay(delay)
-	, m_swapped(false)
 {
 	m_rc.x = m_grid.ObjectX(std::min(x1, x2));
 	m_rc.y = m_grid.ObjectY(std::min(y1, y2));
@@ -70,39 +121,21 @@ AnimateSwap::AnimateSwap(Grid& grid, int x1, int y1, int clr1, int x2, int y2, i
 	m_rc.h = (abs(y1 - y2) + 1) * m_grid.ObjectHeight();
 
 	if (x1 > x2 || y1 > y2) std::swap(m_clr1, m_clr2);
-
-	m_animStartTS = SDL_GetTicks();
 }
 
-bool AnimateSwap::Draw()
+void AnimateSwap::Draw(Uint32 elapsed)
 {
-	const Uint32 ts = SDL_GetTicks();
-
-	Uint32 timePassed = ts - m_animStartTS;
-
-	if (timePassed < m_delay)
-		return false;
-
 	const double durMult = m_wrong ? 2.0 : 1.0;
 
-	double pos = (timePassed - m_delay) / (DURATION / durMult);
-		
-	bool ret = false;
+	double pos = elapsed / (DURATION / durMult);
 
-	if (pos > durMult)
-	{
-		pos = durMult;
-		ret = true;
-	}
+	int clr1 = m_clr1;
+	int clr2 = m_clr2;
 
 	if (m_wrong && pos > 1)
 	{
 		pos = pos - 1;
-		if (!m_swapped)
-		{
-			std::swap(m_clr1, m_clr2);
-			m_swapped = true;
-		}
+		std::swap(clr1, clr2);
 	}
 
 //	SDL_Color c = { 0, 0, 128, SDL_ALPHA_OPAQUE };
@@ -113,13 +146,11 @@ bool AnimateSwap::Draw()
 	const int x2 = m_rc.x + m_rc.w - m_grid.ObjectWidth()  - int(pos * (m_rc.w - m_grid.ObjectWidth())  + 0.5);
 	const int y2 = m_rc.y + m_rc.h - m_grid.ObjectHeight() - int(pos * (m_rc.h - m_grid.ObjectHeight()) + 0.5);
 
-	m_grid.DrawObject(x1, y1, m_clr1);
-	m_grid.DrawObject(x2, y2, m_clr2);
-
-	return ret;
+	m_grid.DrawObject(x1, y1, clr1);
+	m_grid.DrawObject(x2, y2, clr2);
 }
 
-AnimateScaling::AnimateScaling(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr, Uint32 delay, bool scaleDown)
+AnimateScaling::AnimateScaling(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr, bool scaleDown)
 	: m_grid(grid)
 	, m_x(x)
 	, m_y(y)
@@ -128,43 +159,17 @@ AnimateScaling::AnimateScaling(Grid& grid, int x, int y, int count, int xMult, i
 	, m_yMult(yMult)
 	, m_clr(clr)
 	, m_scaleDown(scaleDown)
-	, m_animStartTS(SDL_GetTicks())
-	, m_delay(delay)
 {
 }
 
-bool AnimateScaling::Draw()
+void AnimateScaling::Draw(Uint32 elapsed)
 {
-	const Uint32 ts = SDL_GetTicks();
-
-	Uint32 timePassed = ts - m_animStartTS;
-
-	if (timePassed < m_delay)
-		return false;
-
-	double scale;
-	bool ret = false;
+	double scale = double(elapsed) / DURATION;
 
 	if (m_scaleDown)
-	{
-		scale = 1 - double(timePassed - m_delay) / DURATION;
+		scale = 1 - scale;
 
-		if (scale <= 0)
-		{
-			scale = 0;
-			ret = true;
-		}
-	}
-	else
-	{
-		scale = double(timePassed - m_delay) / DURATION;
-
-		if (scale >= 1)
-		{
-			scale = 1;
-			ret = true;
-		}
-	}
+	scale = m_grid.QuantizeScale(scale);
 
 	int x = m_grid.ObjectX(m_x);
 	int y = m_grid.ObjectY(m_y);
@@ -177,18 +182,37 @@ bool AnimateScaling::Draw()
 
 	for (int i = 0; i < m_count; i++, x += (m_xMult * m_grid.ObjectWidth()), y += (m_yMult * m_grid.ObjectHeight()))
 		m_grid.DrawObject(x, y, m_clr, scale);
+}
+
+AnimateColumnAddition::AnimateColumnAddition(Grid& grid, int x, int y1, int y2, const int* column)
+	: m_grid(grid)
+	, m_x(x)
+	, m_y1(y1)
+	, m_y2(y2)
+{
+	memcpy(m_column, column, sizeof(int) * (m_y2 - m_y1 + 1));
+}
+
+void AnimateColumnAddition::Draw(Uint32 elapsed)
+{
+	const double scale = m_grid.QuantizeScale(double(elapsed) / AnimateScaling::DURATION);
 
-	return ret;
+	const int x = m_grid.ObjectX(m_x);
+	int y = m_grid.ObjectY(m_y1);
+
+	const SDL_Rect rc = { x, y, m_grid.ObjectWidth(), m_grid.ObjectHeight() * (m_y2 - m_y1 + 1) };
+	m_grid.ClearRect(rc);
+
+	for (int i = 0; i <= m_y2 - m_y1; ++i, y += m_grid.ObjectHeight())
+		m_grid.DrawObject(x, y, m_column[i], scale);
 }
 
-AnimateSlide::AnimateSlide(Grid& grid, int x, int y1, int y2, int* column, Uint32 duration, Uint32 delay)
+AnimateSlide::AnimateSlide(Grid& grid, int x, int y1, int y2, int* column, Uint32 duration)
 	: m_grid(grid)
 	, m_x(x)
 	, m_y1(y1)
 	, m_y2(y2)
-	, m_animStartTS(SDL_GetTicks())
 	, m_duration(duration)
-	, m_delay(delay)
 {
 	m_length = m_y1;
 		
@@ -201,26 +225,9 @@ AnimateSlide::AnimateSlide(Grid& grid, int x, int y1, int y2, int* column, Uint3
 	memcpy(m_column, column, sizeof(int) * m_length);
 }
 		
-bool AnimateSlide::Draw()
+void AnimateSlide::Draw(Uint32 elapsed)
 {
-	const Uint32 ts = SDL_GetTicks();
-
-	Uint32 timePassed = ts - m_animStartTS;
-
-	if (timePassed < m_delay)
-		return false;
-
-	timePassed -= m_delay;
-
-	double pc = double(timePassed) / m_duration;
-
-	bool ret = false;
-
-	if (pc >= 1)
-	{
-		pc = 1;
-		ret = true;
-	}		
+	const double pc = double(elapsed) / m_duration;
 
 	int y = m_grid.ObjectY(m_y1 - m_length);
 
@@ -235,6 +242,4 @@ bool AnimateSlide::Draw()
 	{
 		m_grid.DrawObject(m_grid.ObjectX(m_x), y, m_column[i]);
 	}
-
-	return ret;
 }
@@ -1,8 +1,8 @@
 #pragma once
 
 #include <SDL_rect.h>
-#include <memory>
-#include <list>
+#include <cstddef>
+#include <vector>
 
 #include "Grid.h"
 
@@ -13,33 +13,67 @@ class Animation
 {
 public:
 	virtual ~Animation() {}
-	virtual bool Draw() = 0;
+	virtual Uint32 Duration() const = 0;
+	// Draws the frame elapsed ms into the animation, 0 <= elapsed <= Duration()
+	virtual void Draw(Uint32 elapsed) = 0;
 };
 
+// Timeline of animations sorted by start time. Start times are relative to
+// the moment the first animation is added to an idle timeline, so a whole
+// cascade is laid out up front. Draw only walks animations that have started.
+// Animations live in an arena owned by the timeline, so once it has warmed
+// up a cascade does not touch the heap.
 class Animations
 {
 public:
+	Animations();
 	~Animations();
 
-	void AddAnimation(std::auto_ptr<Animation> anim);
+	// anim must be created with new (animations)
+	void AddAnimation(Animation* anim, Uint32 start);
 
-	bool Active() const { return !m_animations.empty(); }
+	bool Active() const { return !m_entries.empty(); }
+	// Time from the timeline start until the last animation ends
+	Uint32 Duration() const { return m_duration; }
 
 	void Draw(SDL_Renderer* rend);
 
 	void Cancel();
 
+	void* Allocate(size_t size);
+
 private:
-	std::list<Animation*> m_animations;
+	static const size_t BLOCK_SIZE = 65536;
+
+	struct Entry
+	{
+		Uint32 start;
+		Animation* anim;
+
+		bool operator<(const Entry& e) const { return start < e.start; }
+	};
+
+	std::vector<Entry> m_entries;
+	size_t m_started;
+	Uint32 m_startTS;
+	Uint32 m_duration;
 	Uint32 m_animEvent;
+
+	std::vector<char*> m_blocks;
+	size_t m_block;
+	size_t m_used;
 };
 
+inline void* operator new(size_t size, Animations& anims) { return anims.Allocate(size); }
+inline void operator delete(void*, Animations&) { }
+
 class AnimateSwap : public Animation
 {
 public:
-	AnimateSwap(Grid& grid, int x1, int y1, int clr1, int x2, int y2, int clr2, bool wrong, Uint32 delay);
+	AnimateSwap(Grid& grid, int x1, int y1, int clr1, int x2, int y2, int clr2, bool wrong);
 
-	virtual bool Draw();
+	virtual Uint32 Duration() const { return DURATION; }
+	virtual void Draw(Uint32 elapsed);
 
 	static const Uint32 DURATION;
 
@@ -47,19 +81,17 @@ private:
 	Grid& m_grid;
 	int m_clr1, m_clr2;
 	bool m_wrong;
-	Uint32 m_delay;
 
-	Uint32 m_animStartTS;
 	SDL_Rect m_rc;
-	bool m_swapped;	
 };
 
 class AnimateScaling : public Animation
 {
 public:
-	AnimateScaling(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr, Uint32 delay, bool scaleDown);
+	AnimateScaling(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr, bool scaleDown);
 
-	virtual bool Draw();
+	virtual Uint32 Duration() const { return DURATION; }
+	virtual void Draw(Uint32 elapsed);
 
 	static const Uint32 DURATION;
 
@@ -70,15 +102,13 @@ private:
 	int m_xMult, m_yMult;
 	int m_clr;
 	bool m_scaleDown;
-	Uint32 m_animStartTS;
-	Uint32 m_delay;
 };
 
 class AnimateRemoval :  public AnimateScaling
 {
 public:
-	AnimateRemoval(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr, Uint32 delay)
-		: AnimateScaling(grid, x, y, count, xMult, yMult, clr, delay, true)
+	AnimateRemoval(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr)
+		: AnimateScaling(grid, x, y, count, xMult, yMult, clr, true)
 	{
 	}
 };
@@ -86,17 +116,35 @@ public:
 class AnimateAddition :  public AnimateScaling
 {
 public:
-	AnimateAddition(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr, Uint32 delay)
-		: AnimateScaling(grid, x, y, count, xMult, yMult, clr, delay, false)
+	AnimateAddition(Grid& grid, int x, int y, int count, int xMult, int yMult, int clr)
+		: AnimateScaling(grid, x, y, count, xMult, yMult, clr, false)
 	{
 	}
 };
 
+// A column run of refilled cells growing in at once, the cheaper form of an
+// AnimateAddition per cell
+class AnimateColumnAddition : public Animation
+{
+public:
+	AnimateColumnAddition(Grid& grid, int x, int y1, int y2, const int* column);
+
+	virtual Uint32 Duration() const { return AnimateScaling::DURATION; }
+	virtual void Draw(Uint32 elapsed);
+
+private:
+	Grid& m_grid;
+	int m_x;
+	int m_y1;
+	int m_y2;
+	int m_column[GRID_HEIGHT];
+};
+
 class AnimateHorzRemoval : public AnimateRemoval
 {
 public:
-	AnimateHorzRemoval(Grid& grid, int x, int y, int count, int clr, Uint32 delay)
-		: AnimateRemoval(grid, x, y, count, 1, 0, clr, delay)
+	AnimateHorzRemoval(Grid& grid, int x, int y, int count, int clr)
+		: AnimateRemoval(grid, x, y, count, 1, 0, clr)
 	{
 	}
 };
@@ -104,8 +152,8 @@ public:
 class AnimateVertRemoval : public AnimateRemoval
 {
 public:
-	AnimateVertRemoval(Grid& grid, int x, int y, int count, int clr, Uint32 delay)
-		: AnimateRemoval(grid, x, y, count, 0, 1, clr, delay)
+	AnimateVertRemoval(Grid& grid, int x, int y, int count, int clr)
+		: AnimateRemoval(grid, x, y, count, 0, 1, clr)
 	{
 	}
 };
@@ -113,9 +161,10 @@ public:
 class AnimateSlide : public Animation
 {
 public:
-	AnimateSlide(Grid& grid, int x, int y1, int y2, int* column, Uint32 duration, Uint32 delay);
+	AnimateSlide(Grid& grid, int x, int y1, int y2, int* column, Uint32 duration);
 		
-	bool Draw();
+	virtual Uint32 Duration() const { return m_duration; }
+	virtual void Draw(Uint32 elapsed);
 
 	static const Uint32 STEP_DURATION;
 
@@ -126,7 +175,5 @@ private:
 	int m_y2;	
 	int m_length;
 	int m_column[GRID_HEIGHT];
-	Uint32 m_animStartTS;
 	Uint32 m_duration;
-	Uint32 m_delay;
 };
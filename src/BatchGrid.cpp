@@ -0,0 +1,362 @@
+#include "BatchGrid.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Equality rows Mark() keeps for the previous cell in each direction: two
+// alternating rows down a column and two alternating columns across the grid
+const size_t EQ_ROWS = 2 + 2 * GRID_HEIGHT;
+
+static size_t EqRow(int dir, int x, int y)
+{
+	return dir == 0 ? size_t(y & 1) : size_t(2 + (x & 1) * GRID_HEIGHT + y);
+}
+
+BatchGrid::BatchGrid(size_t count, uint32_t seed, unsigned maxSteps)
+	: m_count(count)
+	, m_maxSteps(maxSteps)
+	, m_cells(count * GRID_CELLS)
+	, m_marks(count * GRID_CELLS)
+	, m_active(count)
+	, m_special(count)
+	, m_long(count)
+	, m_eq(EQ_ROWS * count)
+	, m_rng(count)
+	, m_steps(count)
+	, m_score(count)
+	, m_swapped(count)
+{
+	for (size_t b = 0; b < m_count; ++b)
+		m_rng[b] = SeedRandom(seed + uint32_t(b));
+
+	Reset();
+}
+
+void BatchGrid::Reset()
+{
+	for (size_t b = 0; b < m_count; ++b)
+		Reset(b);
+}
+
+void BatchGrid::Reset(size_t board)
+{
+	for (int x = 0; x < GRID_WIDTH; ++x)
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+			At(board, x, y) = EMPTY;
+
+	Refill(board);
+
+	m_steps[board] = 0;
+	m_score[board] = 0;
+}
+
+void BatchGrid::Step(const int* actions, int* rewards, uint8_t* done)
+{
+	for (size_t b = 0; b < m_count; ++b)
+	{
+		rewards[b] = 0;
+		m_swapped[b] = ApplySwap(b, actions[b]) ? actions[b] : -1;
+	}
+
+	bool first = true;
+
+	while (Mark())
+	{
+		for (size_t b = 0; b < m_count; ++b)
+		{
+			if (!m_active[b]) continue;
+
+			// Plain runs are resolved by the marks alone
+			if ((m_special[b] & CELL_SPECIAL) || m_long[b])
+				Resolve(b);
+
+			Collapse(b);
+			const int reward = Refill(b) * CELL_SCORE;
+			rewards[b] += reward;
+			m_score[b] += reward;
+		}
+
+		if (first)
+		{
+			// swaps which did not produce a match are taken back, as Grid::Swap does
+			for (size_t b = 0; b < m_count; ++b)
+				if (m_swapped[b] >= 0 && !m_active[b])
+					ApplySwap(b, m_swapped[b]);
+
+			first = false;
+		}
+	}
+
+	if (first)
+	{
+		for (size_t b = 0; b < m_count; ++b)
+			if (m_swapped[b] >= 0)
+				ApplySwap(b, m_swapped[b]);
+	}
+
+	for (size_t b = 0; b < m_count; ++b)
+	{
+		done[b] = (++m_steps[b] >= m_maxSteps);
+		if (done[b]) Reset(b);
+	}
+}
+
+bool BatchGrid::ApplySwap(size_t board, int action)
+{
+	if (action < 0 || action >= ACTION_COUNT) return false;
+
+	const int cell = action / 2;
+	const int x = cell / GRID_HEIGHT;
+	const int y = cell % GRID_HEIGHT;
+	const bool down = (action & 1) != 0;
+
+	const int x2 = down ? x : x + 1;
+	const int y2 = down ? y + 1 : y;
+
+	if (x2 >= GRID_WIDTH || y2 >= GRID_HEIGHT) return false;
+
+	uint8_t& clr1 = At(board, x, y);
+	uint8_t& clr2 = At(board, x2, y2);
+
+	if (CellColor(clr1) == CellColor(clr2)) return false;
+
+	std::swap(clr1, clr2);
+	return true;
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BATCH_SSE2
+#endif
+
+// A run of LINE_RANGE is two overlapping runs of MIN_RANGE
+static_assert(LINE_RANGE == MIN_RANGE + 1, "Mark() chains one previous run");
+
+// Byte kernels over one SoA row; masks are 0x00 / 0xff. Cells compare by
+// color, special tile flags are masked off.
+
+// Finds the boards with a run of MIN_RANGE cells starting at cells and going
+// step bytes per cell: eq receives the run mask, the run's cells are marked
+// and, with the mask of the run one cell back in prev, longRuns collects the
+// boards whose run goes on for LINE_RANGE cells.
+static void MarkRun(uint8_t* marks, uint8_t* eq, uint8_t* longRuns, const uint8_t* prev, const uint8_t* cells, size_t step, size_t n)
+{
+	size_t i = 0;
+#ifdef BATCH_SSE2
+	const __m128i color = _mm_set1_epi8(CELL_COLOR_MASK);
+	for (; i + 16 <= n; i += 16)
+	{
+		const __m128i c0 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(cells + i)), color);
+		__m128i run = _mm_set1_epi8(-1);
+
+		for (int k = 1; k < MIN_RANGE; ++k)
+		{
+			const __m128i ck = _mm_and_si128(_mm_loadu_si128((const __m128i*)(cells + size_t(k) * step + i)), color);
+			run = _mm_and_si128(run, _mm_cmpeq_epi8(c0, ck));
+		}
+
+		_mm_storeu_si128((__m128i*)(eq + i), run);
+
+		for (int k = 0; k < MIN_RANGE; ++k)
+		{
+			__m128i* mk = (__m128i*)(marks + size_t(k) * step + i);
+			_mm_storeu_si128(mk, _mm_or_si128(_mm_loadu_si128(mk), run));
+		}
+
+		if (prev)
+		{
+			const __m128i vp = _mm_loadu_si128((const __m128i*)(prev + i));
+			const __m128i vl = _mm_loadu_si128((const __m128i*)(longRuns + i));
+			_mm_storeu_si128((__m128i*)(longRuns + i), _mm_or_si128(vl, _mm_and_si128(run, vp)));
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		uint8_t run = 0xff;
+
+		for (int k = 1; k < MIN_RANGE; ++k)
+			if (CellColor(cells[size_t(k) * step + i]) != CellColor(cells[i])) run = 0;
+
+		eq[i] = run;
+
+		for (int k = 0; k < MIN_RANGE; ++k)
+			marks[size_t(k) * step + i] |= run;
+
+		if (prev) longRuns[i] |= run & prev[i];
+	}
+}
+
+// active |= marks, special |= the flags of marked cells
+static void OrMarked(uint8_t* active, uint8_t* special, const uint8_t* marks, const uint8_t* cells, size_t n)
+{
+	size_t i = 0;
+#ifdef BATCH_SSE2
+	for (; i + 16 <= n; i += 16)
+	{
+		const __m128i vm = _mm_loadu_si128((const __m128i*)(marks + i));
+		const __m128i vc = _mm_loadu_si128((const __m128i*)(cells + i));
+		const __m128i va = _mm_loadu_si128((const __m128i*)(active + i));
+		const __m128i vs = _mm_loadu_si128((const __m128i*)(special + i));
+		_mm_storeu_si128((__m128i*)(active + i), _mm_or_si128(va, vm));
+		_mm_storeu_si128((__m128i*)(special + i), _mm_or_si128(vs, _mm_and_si128(vm, vc)));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		active[i] |= marks[i];
+		special[i] |= marks[i] & cells[i];
+	}
+}
+
+// Marks cells belonging to runs of MIN_RANGE or more on every board at once.
+// Every kernel walks one cell's row of the SoA storage, so there are no
+// dependencies between boards and 16 boards are handled per SSE2 instruction.
+// Boards whose marks take a special tile or hold a run long enough to create
+// one are flagged for Resolve; for all others the marks are final.
+bool BatchGrid::Mark()
+{
+	const size_t n = m_count;
+	const uint8_t* cells = &m_cells[0];
+	uint8_t* marks = &m_marks[0];
+	uint8_t* longRuns = &m_long[0];
+
+	memset(marks, 0, m_marks.size());
+	memset(longRuns, 0, n);
+
+	const size_t stride[2] = { 1, size_t(GRID_HEIGHT) };
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			const size_t cell = size_t(x * GRID_HEIGHT + y);
+			const bool fits[2] = { y + MIN_RANGE <= GRID_HEIGHT, x + MIN_RANGE <= GRID_WIDTH };
+			const bool chained[2] = { y > 0, x > 0 };
+			const size_t prevRow[2] = { EqRow(0, x, y - 1), EqRow(1, x - 1, y) };
+
+			for (int dir = 0; dir < 2; ++dir)
+			{
+				if (!fits[dir]) continue;
+
+				const uint8_t* prev = chained[dir] ? &m_eq[prevRow[dir] * n] : NULL;
+
+				MarkRun(marks + cell * n, &m_eq[EqRow(dir, x, y) * n], longRuns, prev, cells + cell * n, stride[dir] * n, n);
+			}
+		}
+	}
+
+	uint8_t* active = &m_active[0];
+	uint8_t* special = &m_special[0];
+	memset(active, 0, n);
+	memset(special, 0, n);
+
+	for (size_t cell = 0; cell < size_t(GRID_CELLS); ++cell)
+		OrMarked(active, special, marks + cell * n, cells + cell * n, n);
+
+	uint8_t any = 0;
+	for (size_t b = 0; b < n; ++b)
+		any |= active[b];
+
+	return any != 0;
+}
+
+// Boards flagged by Mark() go through the same code as Board, one at a time,
+// to fire the removed special tiles and place the new ones
+void BatchGrid::Resolve(size_t board)
+{
+	TBoardCells cells;
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+			cells[x][y] = At(board, x, y);
+
+	const Board::TMask removed = Board::Resolve(cells);
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			const size_t idx = size_t(x * GRID_HEIGHT + y) * m_count + board;
+			m_cells[idx] = cells[x][y];
+			m_marks[idx] = (removed >> (x * GRID_HEIGHT + y)) & 1 ? 0xff : 0;
+		}
+	}
+}
+
+// Drops the unmarked cells of every column down, leaving EMPTY on top
+int BatchGrid::Collapse(size_t board)
+{
+	int removed = 0;
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		int dst = GRID_HEIGHT - 1;
+
+		for (int y = GRID_HEIGHT - 1; y >= 0; --y)
+		{
+			const size_t idx = size_t(x * GRID_HEIGHT + y) * m_count + board;
+
+			if (m_marks[idx]) continue;
+
+			At(board, x, dst--) = m_cells[idx];
+		}
+
+		removed += dst + 1;
+
+		for (; dst >= 0; --dst)
+			At(board, x, dst) = EMPTY;
+	}
+
+	return removed;
+}
+
+// Fills EMPTY cells with colors that do not complete a run, like Grid::Randomize
+int BatchGrid::Refill(size_t board)
+{
+	int filled = 0;
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			uint8_t& cell = At(board, x, y);
+
+			if (cell != EMPTY) continue;
+
+			++filled;
+
+			do
+			{
+				cell = uint8_t(NextRandom(m_rng[board]) % OBJ_COUNT);
+			}
+			while (CanRemove(board, x, y));
+		}
+	}
+
+	return filled;
+}
+
+bool BatchGrid::CanRemove(size_t board, int x, int y)
+{
+	int xcount = 0;
+	int ycount = 0;
+
+	const int clr = CellColor(At(board, x, y));
+
+	for (int i = x; i >= std::max(0, x - MIN_RANGE + 1); --i)
+		if (CellColor(At(board, i, y)) == clr) ++xcount; else break;
+
+	for (int i = x; i < std::min(GRID_WIDTH, x + MIN_RANGE); ++i)
+		if (CellColor(At(board, i, y)) == clr) ++xcount; else break;
+
+	if (xcount >= MIN_RANGE) return true;
+
+	for (int i = y; i >= std::max(0, y - MIN_RANGE + 1); --i)
+		if (CellColor(At(board, x, i)) == clr) ++ycount; else break;
+
+	for (int i = y; i < std::min(GRID_HEIGHT, y + MIN_RANGE); ++i)
+		if (CellColor(At(board, x, i)) == clr) ++ycount; else break;
+
+	return ycount >= MIN_RANGE;
+}
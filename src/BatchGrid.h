@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "Board.h"
+
+// Many independent boards stepped together, without SDL or animations,
+// following the rules of Board (and so of Grid), special tiles included.
+// Cells are stored structure-of-arrays: all boards' values for one cell are
+// contiguous, so match detection runs as straight byte loops across boards
+// that the compiler turns into SIMD compares.
+class BatchGrid
+{
+public:
+	// Action = cell index (x * GRID_HEIGHT + y) * 2 + (0: swap right, 1: swap down)
+	static const int ACTION_COUNT = GRID_CELLS * 2;
+	static const uint8_t EMPTY = 0xff;
+
+	BatchGrid(size_t count, uint32_t seed, unsigned maxSteps);
+
+	size_t Count() const { return m_count; }
+
+	void Reset();
+	void Reset(size_t board);
+
+	// Applies one action per board and resolves all cascades. rewards receive
+	// the score delta of each board, done is set when a board used up its
+	// maxSteps; such boards are reset before the call returns.
+	void Step(const int* actions, int* rewards, uint8_t* done);
+
+	static int Action(int x, int y, bool down) { return (x * GRID_HEIGHT + y) * 2 + (down ? 1 : 0); }
+
+	int Cell(size_t board, int x, int y) const { return m_cells[size_t(x * GRID_HEIGHT + y) * m_count + board]; }
+	int Score(size_t board) const { return m_score[board]; }
+
+	// Raw structure-of-arrays storage, Count() bytes per cell
+	const uint8_t* Cells() const { return &m_cells[0]; }
+
+private:
+	uint8_t& At(size_t board, int x, int y) { return m_cells[size_t(x * GRID_HEIGHT + y) * m_count + board]; }
+
+	bool ApplySwap(size_t board, int action);
+	bool Mark();
+	void Resolve(size_t board);
+	int Collapse(size_t board);
+	int Refill(size_t board);
+	bool CanRemove(size_t board, int x, int y);
+
+	size_t m_count;
+	unsigned m_maxSteps;
+	std::vector<uint8_t> m_cells;
+	std::vector<uint8_t> m_marks;
+	std::vector<uint8_t> m_active;
+	std::vector<uint8_t> m_special;	// special flags among marked cells
+	std::vector<uint8_t> m_long;	// runs of LINE_RANGE or more
+	std::vector<uint8_t> m_eq;
+	std::vector<uint32_t> m_rng;
+	std::vector<unsigned> m_steps;
+	std::vector<int> m_score;
+	std::vector<int> m_swapped;
+};
@@ -0,0 +1,261 @@
+#include "Board.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static_assert(GRID_CELLS <= 64, "Board::TMask holds one bit per cell");
+
+static const uint8_t EMPTY = 0xff;
+
+void Board::NewGame(uint32_t seed)
+{
+	m_rng = SeedRandom(seed);
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+			m_cells[x][y] = EMPTY;
+
+	Refill();
+
+	m_score = 0;
+}
+
+void Board::Load(const TBoardCells& cells, uint32_t seed)
+{
+	m_rng = SeedRandom(seed);
+	memcpy(m_cells, cells, sizeof(m_cells));
+	m_score = 0;
+}
+
+int Board::Swap(int x1, int y1, int x2, int y2)
+{
+	if (x1 < 0 || y1 < 0 || x2 < 0 || y2 < 0 ||
+		x1 >= GRID_WIDTH || x2 >= GRID_WIDTH || y1 >= GRID_HEIGHT || y2 >= GRID_HEIGHT)
+		return 0;
+
+	if (abs(x1 - x2) + abs(y1 - y2) != 1)
+		return 0;
+
+	uint8_t& clr1 = m_cells[x1][y1];
+	uint8_t& clr2 = m_cells[x2][y2];
+
+	if (CellColor(clr1) == CellColor(clr2)) return 0;
+
+	std::swap(clr1, clr2);
+
+	TMask removed = Resolve(m_cells);
+
+	if (!removed)
+	{
+		std::swap(clr1, clr2);
+		return 0;
+	}
+
+	int steps = 0;
+
+	do
+	{
+		Collapse(removed);
+		m_score += Refill() * CELL_SCORE;
+		++steps;
+	}
+	while ((removed = Resolve(m_cells)) != 0);
+
+	return steps;
+}
+
+static Board::TMask Bit(int x, int y)
+{
+	return Board::TMask(1) << (x * GRID_HEIGHT + y);
+}
+
+Board::TMask Board::Resolve(TBoardCells& cells)
+{
+	struct Special
+	{
+		int x, y;
+		int flag;
+	};
+
+	TMask removed = 0;
+
+	Special created[GRID_CELLS];
+	int createdCount = 0;
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		int yStart = 0, y = 1;
+
+		for (; y <= GRID_HEIGHT; ++y)
+		{
+			if (y < GRID_HEIGHT && CellColor(cells[x][y]) == CellColor(cells[x][yStart]))
+				continue;
+
+			const int len = y - yStart;
+
+			if (len >= MIN_RANGE)
+			{
+				for (int i = yStart; i < y; ++i)
+					removed |= Bit(x, i);
+
+				if (len >= LINE_RANGE)
+				{
+					const Special sp = { x, yStart + len / 2, len >= BOMB_RANGE ? CELL_BOMB : CELL_LINE_V };
+					created[createdCount++] = sp;
+				}
+			}
+
+			yStart = y;
+		}
+	}
+
+	for (int y = 0; y < GRID_HEIGHT; ++y)
+	{
+		int xStart = 0, x = 1;
+
+		for (; x <= GRID_WIDTH; ++x)
+		{
+			if (x < GRID_WIDTH && CellColor(cells[x][y]) == CellColor(cells[xStart][y]))
+				continue;
+
+			const int len = x - xStart;
+
+			if (len >= MIN_RANGE)
+			{
+				for (int i = xStart; i < x; ++i)
+					removed |= Bit(i, y);
+
+				if (len >= LINE_RANGE)
+				{
+					const Special sp = { xStart + len / 2, y, len >= BOMB_RANGE ? CELL_BOMB : CELL_LINE_H };
+					created[createdCount++] = sp;
+				}
+			}
+
+			xStart = x;
+		}
+	}
+
+	// Chain reaction as in Grid::ResolveSpecials, on masks: every special is
+	// fired at most once and each color is bombed at most once
+	TMask specials = 0;
+	TMask colors[CELL_COLOR_MASK + 1] = { 0 };
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			if (cells[x][y] & CELL_SPECIAL) specials |= Bit(x, y);
+			colors[CellColor(cells[x][y])] |= Bit(x, y);
+		}
+	}
+
+	bool bombed[CELL_COLOR_MASK + 1] = { false };
+	TMask todo = removed & specials;
+
+	while (todo)
+	{
+		int i = 0;
+		while (!(todo & (TMask(1) << i)))
+			++i;
+
+		todo &= ~(TMask(1) << i);
+
+		const int x = i / GRID_HEIGHT;
+		const int y = i % GRID_HEIGHT;
+		const int cell = cells[x][y];
+		TMask hit = 0;
+
+		if (cell & CELL_LINE_H)
+		{
+			for (int lx = 0; lx < GRID_WIDTH; ++lx)
+				hit |= Bit(lx, y);
+		}
+		else if (cell & CELL_LINE_V)
+		{
+			for (int ly = 0; ly < GRID_HEIGHT; ++ly)
+				hit |= Bit(x, ly);
+		}
+		else if ((cell & CELL_BOMB) && !bombed[CellColor(cell)])
+		{
+			bombed[CellColor(cell)] = true;
+			hit = colors[CellColor(cell)];
+		}
+
+		todo |= hit & ~removed & specials;
+		removed |= hit;
+	}
+
+	for (int i = 0; i < createdCount; ++i)
+	{
+		const Special& sp = created[i];
+		removed &= ~Bit(sp.x, sp.y);
+		cells[sp.x][sp.y] = uint8_t(CellColor(cells[sp.x][sp.y]) | sp.flag);
+	}
+
+	return removed;
+}
+
+void Board::Collapse(TMask removed)
+{
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		int dst = GRID_HEIGHT - 1;
+
+		for (int y = GRID_HEIGHT - 1; y >= 0; --y)
+			if (!(removed & Bit(x, y)))
+				m_cells[x][dst--] = m_cells[x][y];
+
+		for (; dst >= 0; --dst)
+			m_cells[x][dst] = EMPTY;
+	}
+}
+
+// Same order and constraint as Grid::Randomize
+int Board::Refill()
+{
+	int filled = 0;
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			if (m_cells[x][y] != EMPTY) continue;
+
+			++filled;
+
+			do
+			{
+				m_cells[x][y] = uint8_t(NextRandom(m_rng) % OBJ_COUNT);
+			}
+			while (CanRemove(x, y));
+		}
+	}
+
+	return filled;
+}
+
+bool Board::CanRemove(int x, int y) const
+{
+	int xcount = 0;
+	int ycount = 0;
+
+	const int clr = CellColor(m_cells[x][y]);
+
+	for (int i = x; i >= std::max(0, x - MIN_RANGE + 1); --i)
+		if (CellColor(m_cells[i][y]) == clr) ++xcount; else break;
+
+	for (int i = x; i < std::min(GRID_WIDTH, x + MIN_RANGE); ++i)
+		if (CellColor(m_cells[i][y]) == clr) ++xcount; else break;
+
+	if (xcount >= MIN_RANGE) return true;
+
+	for (int i = y; i >= std::max(0, y - MIN_RANGE + 1); --i)
+		if (CellColor(m_cells[x][i]) == clr) ++ycount; else break;
+
+	for (int i = y; i < std::min(GRID_HEIGHT, y + MIN_RANGE); ++i)
+		if (CellColor(m_cells[x][i]) == clr) ++ycount; else break;
+
+	return ycount >= MIN_RANGE;
+}
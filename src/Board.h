@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+
+// Board geometry and rules shared by the SDL front end and the headless code
+
+const int GRID_WIDTH  = 8;
+const int GRID_HEIGHT = 8;
+const int GRID_CELLS  = GRID_WIDTH * GRID_HEIGHT;
+const int OBJ_WIDTH = 40;
+const int OBJ_HEIGHT = 40;
+const int OBJ_COUNT = 5;
+const int RND_CELL = -1;
+const int MIN_RANGE = 3;
+const int CELL_SCORE = 10;
+const unsigned GAME_LEN = 60000; // 60 sec
+
+// Grid cells keep the color in the low bits and special tile flags above it.
+// A 4-in-a-row leaves a line clear along its direction, 5 or more a color bomb
+// that clears every cell of its color. Board and BatchGrid play the same rules.
+const int CELL_COLOR_MASK = 0x0f;
+const int CELL_LINE_H = 0x10;
+const int CELL_LINE_V = 0x20;
+const int CELL_BOMB = 0x40;
+const int CELL_SPECIAL = CELL_LINE_H | CELL_LINE_V | CELL_BOMB;
+const int LINE_RANGE = 4;
+const int BOMB_RANGE = 5;
+
+inline int CellColor(int cell) { return cell & CELL_COLOR_MASK; }
+
+typedef int TCells[GRID_WIDTH][GRID_HEIGHT];
+typedef uint8_t TBoardCells[GRID_WIDTH][GRID_HEIGHT];
+
+// xorshift32, state must not be 0
+inline uint32_t NextRandom(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+inline uint32_t SeedRandom(uint32_t seed)
+{
+	return seed * 2654435761u | 1;
+}
+
+// Single board following the rules of Grid, special tiles included, without
+// SDL and animations. Small and trivially copyable, so it can be pooled and
+// copied freely.
+class Board
+{
+public:
+	typedef uint64_t TMask; // bit x * GRID_HEIGHT + y
+
+	// Marks the cells one cascade step removes: runs and whatever their special
+	// tiles clear. Long runs leave a special tile in their middle instead, as
+	// Grid::GetRemovedRanges does.
+	static TMask Resolve(TBoardCells& cells);
+
+	void NewGame(uint32_t seed);
+	void Load(const TBoardCells& cells, uint32_t seed);
+
+	// Swaps two adjacent cells and resolves the cascade. Returns the number
+	// of cascade steps, 0 when the swap does not match and nothing changed.
+	int Swap(int x1, int y1, int x2, int y2);
+
+	int Cell(int x, int y) const { return m_cells[x][y]; }
+	const TBoardCells& Cells() const { return m_cells; }
+	int Score() const { return m_score; }
+
+private:
+	void Collapse(TMask removed);
+	int Refill();
+	bool CanRemove(int x, int y) const;
+
+	TBoardCells m_cells;
+	int32_t m_score;
+	uint32_t m_rng;
+};
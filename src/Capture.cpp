@@ -0,0 +1,218 @@
+#include "Capture.h"
+
+#include <SDL.h>
+#include <cstring>
+
+static const Uint32 CAPTURE_MAGIC = 0x5041434d; // "MCAP"
+static const Uint32 CAPTURE_VERSION = 1;
+
+enum
+{
+	FRAME_RAW = 0,
+	FRAME_RLE = 1	// (run length, pixel) pairs of Uint32
+};
+
+// File: magic, version, pixel format, then per frame
+// { w, h, timestamp ms, encoding, payload bytes } and the payload
+
+FrameCapture::FrameCapture()
+	: m_rend(0)
+	, m_file(0)
+	, m_queueHead(0)
+	, m_queueTail(0)
+	, m_queued(0)
+	, m_thread(0)
+	, m_lock(0)
+	, m_ready(0)
+	, m_stop(false)
+	, m_failed(false)
+	, m_captured(0)
+	, m_dropped(0)
+	, m_oversized(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	Stop();
+}
+
+bool FrameCapture::Start(SDL_Renderer* rend, const char* path, int slots)
+{
+	int w, h;
+	if (slots <= 0 || SDL_GetRendererOutputSize(rend, &w, &h)) return false;
+
+	m_file = fopen(path, "wb");
+	if (!m_file) return false;
+
+	const Uint32 header[3] = { CAPTURE_MAGIC, CAPTURE_VERSION, SDL_PIXELFORMAT_ARGB8888 };
+	fwrite(header, sizeof(header), 1, m_file);
+
+	// frames larger than the window at start are counted as dropped
+	m_slots.resize(size_t(slots));
+	for (int i = 0; i < slots; ++i)
+	{
+		m_slots[i].pixels.resize(size_t(w) * size_t(h));
+		m_free.push_back(i);
+	}
+
+	m_queue.resize(size_t(slots));
+	m_queueHead = m_queueTail = m_queued = 0;
+	m_rle.resize(size_t(w) * size_t(h));
+
+	m_rend = rend;
+	m_lock = SDL_CreateMutex();
+	m_ready = SDL_CreateCond();
+	m_thread = SDL_CreateThread(WriterThread, "FrameCapture", this);
+
+	if (!m_thread)
+	{
+		Stop();
+		return false;
+	}
+
+	return true;
+}
+
+void FrameCapture::Stop()
+{
+	if (!m_file) return;
+
+	if (m_thread)
+	{
+		SDL_LockMutex(m_lock);
+		m_stop = true;
+		SDL_CondSignal(m_ready);
+		SDL_UnlockMutex(m_lock);
+
+		SDL_WaitThread(m_thread, NULL);
+		m_thread = 0;
+	}
+
+	SDL_DestroyCond(m_ready);
+	SDL_DestroyMutex(m_lock);
+	m_ready = 0;
+	m_lock = 0;
+
+	if (fclose(m_file)) m_failed = true;
+	m_file = 0;
+
+	SDL_Log("capture: %u frames written, %u dropped (%u larger than the capture buffers)%s",
+			m_captured, m_dropped, m_oversized, m_failed ? ", write errors" : "");
+}
+
+void FrameCapture::Frame()
+{
+	if (!m_file) return;
+
+	int w, h;
+	SDL_GetRendererOutputSize(m_rend, &w, &h);
+
+	int idx = -1;
+
+	SDL_LockMutex(m_lock);
+	if (!m_free.empty())
+	{
+		idx = m_free.back();
+		m_free.pop_back();
+	}
+	SDL_UnlockMutex(m_lock);
+
+	if (idx < 0)
+	{
+		++m_dropped;
+		return;
+	}
+
+	Slot& slot = m_slots[idx];
+	bool ok = size_t(w) * size_t(h) <= slot.pixels.size();
+
+	if (ok)
+	{
+		slot.w = w;
+		slot.h = h;
+		slot.ts = SDL_GetTicks();
+		ok = SDL_RenderReadPixels(m_rend, NULL, SDL_PIXELFORMAT_ARGB8888, &slot.pixels[0], w * int(sizeof(Uint32))) == 0;
+	}
+	else
+	{
+		++m_oversized;
+	}
+
+	SDL_LockMutex(m_lock);
+	if (ok)
+	{
+		// at most one entry per slot, so the ring cannot overflow
+		m_queue[m_queueTail] = idx;
+		m_queueTail = (m_queueTail + 1) % m_queue.size();
+		++m_queued;
+		SDL_CondSignal(m_ready);
+	}
+	else
+	{
+		m_free.push_back(idx);
+		++m_dropped;
+	}
+	SDL_UnlockMutex(m_lock);
+}
+
+int FrameCapture::WriterThread(void* param)
+{
+	static_cast<FrameCapture*>(param)->Write();
+	return 0;
+}
+
+void FrameCapture::Write()
+{
+	SDL_LockMutex(m_lock);
+
+	for (;;)
+	{
+		while (!m_queued && !m_stop)
+			SDL_CondWait(m_ready, m_lock);
+
+		if (!m_queued)
+			break;
+
+		const int idx = m_queue[m_queueHead];
+		m_queueHead = (m_queueHead + 1) % m_queue.size();
+		--m_queued;
+
+		SDL_UnlockMutex(m_lock);
+		Encode(m_slots[idx]);
+		SDL_LockMutex(m_lock);
+
+		m_free.push_back(idx);
+		++m_captured;
+	}
+
+	SDL_UnlockMutex(m_lock);
+}
+
+// Board frames are mostly flat color, so a run-length pass usually pays off;
+// the raw pixels are written when it does not
+void FrameCapture::Encode(const Slot& slot)
+{
+	const size_t count = size_t(slot.w) * size_t(slot.h);
+	const Uint32* px = &slot.pixels[0];
+	size_t out = 0;
+	size_t i = 0;
+
+	while (i < count && out + 2 <= count)
+	{
+		size_t run = 1;
+		while (i + run < count && px[i + run] == px[i] && run < 0xffffffffu) ++run;
+
+		m_rle[out++] = Uint32(run);
+		m_rle[out++] = px[i];
+		i += run;
+	}
+
+	const bool rle = i == count;
+	const Uint32 frame[5] = { Uint32(slot.w), Uint32(slot.h), slot.ts, Uint32(rle ? FRAME_RLE : FRAME_RAW),
+							  Uint32((rle ? out : count) * sizeof(Uint32)) };
+
+	if (fwrite(frame, sizeof(frame), 1, m_file) != 1 ||
+		fwrite(rle ? &m_rle[0] : px, sizeof(Uint32), rle ? out : count, m_file) != (rle ? out : count))
+		m_failed = true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+#include <cstdio>
+#include <vector>
+
+struct SDL_Renderer;
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+
+// Records presented frames to a file. Frames are read back into a ring of
+// preallocated buffers and written by a background thread; when every buffer
+// is still waiting for the writer the frame is dropped instead of stalling
+// the render loop.
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	bool Start(SDL_Renderer* rend, const char* path, int slots);
+	void Stop();
+
+	bool Active() const { return m_file != 0; }
+
+	// Call right before SDL_RenderPresent
+	void Frame();
+
+	unsigned Captured() const { return m_captured; }
+	unsigned Dropped() const { return m_dropped; }
+
+private:
+	struct Slot
+	{
+		std::vector<Uint32> pixels;
+		int w, h;
+		Uint32 ts;
+	};
+
+	static int WriterThread(void* param);
+	void Write();
+	void Encode(const Slot& slot);
+
+	SDL_Renderer* m_rend;
+	FILE* m_file;
+	std::vector<Slot> m_slots;
+	std::vector<int> m_free;
+	std::vector<int> m_queue;	// ring of filled slots, one entry per slot
+	size_t m_queueHead;
+	size_t m_queueTail;
+	size_t m_queued;
+	std::vector<Uint32> m_rle;
+	SDL_Thread* m_thread;
+	SDL_mutex* m_lock;
+	SDL_cond* m_ready;
+	bool m_stop;
+	bool m_failed;
+	unsigned m_captured;
+	unsigned m_dropped;
+	unsigned m_oversized;
+};
@@ -0,0 +1,339 @@
+#include "Compositor.h"
+#include "Stats.h"
+
+#include <SDL.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define COMPOSITOR_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define COMPOSITOR_AVX2
+	#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+	#include <immintrin.h>
+	#define COMPOSITOR_AVX2
+	#define AVX2_TARGET
+#endif
+
+// Scaled sprites are dropped together when they outgrow this; a window
+// resize drops them too since cell sizes change with it
+static const size_t SCALED_CACHE_BYTES = 8 << 20;
+
+// Premultiplied ARGB: dst = src + dst * (255 - src alpha) / 255
+static inline Uint32 BlendPixel(Uint32 d, Uint32 s)
+{
+	const Uint32 ia = 255 - (s >> 24);
+	if (ia == 0) return s;
+
+	Uint32 out = 0;
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		const Uint32 x = ((d >> shift) & 0xff) * ia + 128;
+		out |= (((s >> shift) & 0xff) + ((x + (x >> 8)) >> 8)) << shift;
+	}
+
+	return out;
+}
+
+static void BlendRowScalar(Uint32* dst, const Uint32* src, int count)
+{
+	for (int i = 0; i < count; ++i)
+		dst[i] = BlendPixel(dst[i], src[i]);
+}
+
+#ifdef COMPOSITOR_SSE2
+
+// Two pixels of dst as 16-bit lanes times their inverse alpha, divided by 255
+static inline __m128i ScaleSSE2(__m128i d16, __m128i ia16)
+{
+	const __m128i x = _mm_add_epi16(_mm_mullo_epi16(d16, ia16), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static void BlendRowSSE2(Uint32* dst, const Uint32* src, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi32(255);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+
+		__m128i ia = _mm_sub_epi32(full, _mm_srli_epi32(s, 24));
+		ia = _mm_or_si128(ia, _mm_slli_epi32(ia, 16));
+
+		const __m128i lo = ScaleSSE2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(ia, ia));
+		const __m128i hi = ScaleSSE2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(ia, ia));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+	}
+
+	BlendRowScalar(dst + i, src + i, count - i);
+}
+
+#endif
+
+#ifdef COMPOSITOR_AVX2
+
+AVX2_TARGET static inline __m256i ScaleAVX2(__m256i d16, __m256i ia16)
+{
+	const __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(d16, ia16), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+// Same as the SSE2 kernel; unpack and pack both work within 128-bit lanes
+AVX2_TARGET static void BlendRowAVX2(Uint32* dst, const Uint32* src, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i full = _mm256_set1_epi32(255);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+
+		__m256i ia = _mm256_sub_epi32(full, _mm256_srli_epi32(s, 24));
+		ia = _mm256_or_si256(ia, _mm256_slli_epi32(ia, 16));
+
+		const __m256i lo = ScaleAVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(ia, ia));
+		const __m256i hi = ScaleAVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(ia, ia));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+	}
+
+	BlendRowScalar(dst + i, src + i, count - i);
+}
+
+#endif
+
+Compositor::Compositor()
+	: m_rend(0)
+	, m_text(0)
+	, m_width(0)
+	, m_height(0)
+	, m_hasDirty(false)
+	, m_scaledBytes(0)
+	, m_blend(BlendRowScalar)
+{
+	SDL_zero(m_dirty);
+}
+
+Compositor::~Compositor()
+{
+	if (m_text) SDL_DestroyTexture(m_text);
+}
+
+bool Compositor::Wanted(SDL_Renderer* rend)
+{
+	SDL_RendererInfo info;
+	return !SDL_GetRendererInfo(rend, &info) && (info.flags & SDL_RENDERER_SOFTWARE);
+}
+
+bool Compositor::Init(SDL_Renderer* rend, SDL_Surface* const* sprites, int count)
+{
+	m_sources.resize(size_t(count));
+
+	for (int i = 0; i < count; ++i)
+	{
+		SDL_Surface* surf = SDL_ConvertSurfaceFormat(sprites[i], SDL_PIXELFORMAT_ARGB8888, 0);
+		if (!surf) return false;
+
+		Sprite& sprite = m_sources[size_t(i)];
+		sprite.w = surf->w;
+		sprite.h = surf->h;
+		sprite.pixels.resize(size_t(surf->w) * size_t(surf->h));
+
+		SDL_LockSurface(surf);
+
+		for (int y = 0; y < surf->h; ++y)
+		{
+			const Uint32* row = reinterpret_cast<const Uint32*>(static_cast<const Uint8*>(surf->pixels) + y * surf->pitch);
+
+			for (int x = 0; x < surf->w; ++x)
+			{
+				const Uint32 p = row[x];
+				const Uint32 a = p >> 24;
+				const Uint32 r = ((p >> 16) & 0xff) * a / 255;
+				const Uint32 g = ((p >> 8) & 0xff) * a / 255;
+				const Uint32 b = (p & 0xff) * a / 255;
+				sprite.pixels[size_t(y) * size_t(surf->w) + size_t(x)] = (a << 24) | (r << 16) | (g << 8) | b;
+			}
+		}
+
+		SDL_UnlockSurface(surf);
+		SDL_FreeSurface(surf);
+	}
+
+#ifdef COMPOSITOR_SSE2
+	if (SDL_HasSSE2()) m_blend = BlendRowSSE2;
+#endif
+#ifdef COMPOSITOR_AVX2
+	if (SDL_HasAVX2()) m_blend = BlendRowAVX2;
+#endif
+
+	m_rend = rend;
+	return true;
+}
+
+// Bilinear resample of the premultiplied source, once per size
+const Compositor::Sprite& Compositor::Scaled(int idx, int w, int h)
+{
+	const Uint32 key = (Uint32(idx) << 24) | (Uint32(w) << 12) | Uint32(h);
+	std::map<Uint32, Sprite>::iterator it = m_scaled.find(key);
+	if (it != m_scaled.end()) return it->second;
+
+	const size_t bytes = size_t(w) * size_t(h) * sizeof(Uint32);
+
+	if (m_scaledBytes + bytes > SCALED_CACHE_BYTES)
+	{
+		m_scaled.clear();
+		m_scaledBytes = 0;
+	}
+
+	m_scaledBytes += bytes;
+
+	const Sprite& src = m_sources[size_t(idx)];
+	Sprite& dst = m_scaled[key];
+	dst.w = w;
+	dst.h = h;
+	dst.pixels.resize(size_t(w) * size_t(h));
+
+	for (int y = 0; y < h; ++y)
+	{
+		const float fy = std::max(0.0f, (float(y) + 0.5f) * float(src.h) / float(h) - 0.5f);
+		const int y0 = std::min(int(fy), src.h - 1);
+		const int y1 = std::min(y0 + 1, src.h - 1);
+		const float ty = fy - float(y0);
+
+		for (int x = 0; x < w; ++x)
+		{
+			const float fx = std::max(0.0f, (float(x) + 0.5f) * float(src.w) / float(w) - 0.5f);
+			const int x0 = std::min(int(fx), src.w - 1);
+			const int x1 = std::min(x0 + 1, src.w - 1);
+			const float tx = fx - float(x0);
+
+			const Uint32 p00 = src.pixels[size_t(y0 * src.w + x0)];
+			const Uint32 p01 = src.pixels[size_t(y0 * src.w + x1)];
+			const Uint32 p10 = src.pixels[size_t(y1 * src.w + x0)];
+			const Uint32 p11 = src.pixels[size_t(y1 * src.w + x1)];
+
+			Uint32 out = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				const float top = float((p00 >> shift) & 0xff) * (1 - tx) + float((p01 >> shift) & 0xff) * tx;
+				const float bottom = float((p10 >> shift) & 0xff) * (1 - tx) + float((p11 >> shift) & 0xff) * tx;
+				out |= Uint32(top * (1 - ty) + bottom * ty + 0.5f) << shift;
+			}
+
+			dst.pixels[size_t(y) * size_t(w) + size_t(x)] = out;
+		}
+	}
+
+	return dst;
+}
+
+// The framebuffer follows the output size; it is checked once per frame
+void Compositor::BeginFrame()
+{
+	int w = 0, h = 0;
+	SDL_GetRendererOutputSize(m_rend, &w, &h);
+
+	if (w == m_width && h == m_height && m_text) return;
+
+	if (m_text) SDL_DestroyTexture(m_text);
+
+	m_text = SDL_CreateTexture(m_rend, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+	m_width = w;
+	m_height = h;
+	m_frame.assign(size_t(w) * size_t(h), 0xff000000);
+	m_hasDirty = false;
+
+	m_scaled.clear();
+	m_scaledBytes = 0;
+}
+
+bool Compositor::Clip(SDL_Rect& rc) const
+{
+	const SDL_Rect bounds = { 0, 0, m_width, m_height };
+	return SDL_IntersectRect(&rc, &bounds, &rc) == SDL_TRUE;
+}
+
+void Compositor::Touch(const SDL_Rect& rc)
+{
+	if (m_hasDirty)
+		SDL_UnionRect(&m_dirty, &rc, &m_dirty);
+	else
+		m_dirty = rc;
+
+	m_hasDirty = true;
+}
+
+void Compositor::DrawSprite(int idx, const SDL_Rect& dest)
+{
+	if (!m_hasDirty) BeginFrame();
+	if (dest.w <= 0 || dest.h <= 0) return;
+
+	const Sprite& sprite = Scaled(idx, dest.w, dest.h);
+
+	SDL_Rect rc = dest;
+	if (!Clip(rc)) return;
+
+	for (int y = rc.y; y < rc.y + rc.h; ++y)
+	{
+		const Uint32* src = &sprite.pixels[size_t(y - dest.y) * size_t(sprite.w) + size_t(rc.x - dest.x)];
+		m_blend(&m_frame[size_t(y) * size_t(m_width) + size_t(rc.x)], src, rc.w);
+	}
+
+	Touch(rc);
+}
+
+void Compositor::FillRect(const SDL_Rect& fill, const SDL_Color& clr)
+{
+	if (!m_hasDirty) BeginFrame();
+
+	SDL_Rect rc = fill;
+	if (!Clip(rc)) return;
+
+	const Uint32 a = clr.a;
+	const Uint32 pixel = (a << 24) | ((clr.r * a / 255) << 16) | ((clr.g * a / 255) << 8) | (clr.b * a / 255);
+
+	for (int y = rc.y; y < rc.y + rc.h; ++y)
+	{
+		Uint32* dst = &m_frame[size_t(y) * size_t(m_width) + size_t(rc.x)];
+
+		if (a == 255)
+			std::fill(dst, dst + rc.w, pixel);
+		else
+			for (int x = 0; x < rc.w; ++x)
+				dst[x] = BlendPixel(dst[x], pixel);
+	}
+
+	Touch(rc);
+}
+
+void Compositor::Clear(const SDL_Color& clr)
+{
+	BeginFrame();
+
+	const SDL_Rect all = { 0, 0, m_width, m_height };
+	FillRect(all, clr);
+}
+
+void Compositor::Flush()
+{
+	if (!m_hasDirty) return;
+
+	const Uint32* pixels = &m_frame[size_t(m_dirty.y) * size_t(m_width) + size_t(m_dirty.x)];
+	SDL_UpdateTexture(m_text, &m_dirty, pixels, m_width * int(sizeof(Uint32)));
+	SDL_RenderCopy(m_rend, m_text, &m_dirty, &m_dirty);
+	DrawCounter::Add();
+
+	m_hasDirty = false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <SDL_rect.h>
+#include <SDL_pixels.h>
+#include <map>
+#include <vector>
+
+struct SDL_Renderer;
+struct SDL_Texture;
+struct SDL_Surface;
+
+// CPU drawing for the software renderer, where every scaled SDL_RenderCopy
+// is filtered and blended per pixel. Sprites are kept premultiplied and
+// pre-scaled per size, blended into a framebuffer with SSE2/AVX2 and the
+// touched area is uploaded through one streaming texture on Flush.
+class Compositor
+{
+public:
+	Compositor();
+	~Compositor();
+
+	// True when rend is SDL's software renderer
+	static bool Wanted(SDL_Renderer* rend);
+
+	bool Init(SDL_Renderer* rend, SDL_Surface* const* sprites, int count);
+	bool Active() const { return m_rend != 0; }
+
+	void DrawSprite(int idx, const SDL_Rect& dest);
+	void FillRect(const SDL_Rect& rc, const SDL_Color& clr);
+	void Clear(const SDL_Color& clr);
+
+	// Copies everything drawn since the last flush to the renderer
+	void Flush();
+
+private:
+	struct Sprite
+	{
+		int w, h;
+		std::vector<Uint32> pixels;
+	};
+
+	typedef void (*TBlendRow)(Uint32* dst, const Uint32* src, int count);
+
+	const Sprite& Scaled(int idx, int w, int h);
+	void BeginFrame();
+	bool Clip(SDL_Rect& rc) const;
+	void Touch(const SDL_Rect& rc);
+
+	SDL_Renderer* m_rend;
+	SDL_Texture* m_text;
+	int m_width, m_height;
+	std::vector<Uint32> m_frame;
+	SDL_Rect m_dirty;
+	bool m_hasDirty;
+
+	std::vector<Sprite> m_sources;
+	std::map<Uint32, Sprite> m_scaled;
+	size_t m_scaledBytes;
+	TBlendRow m_blend;
+};
@@ -0,0 +1,388 @@
+#include "EventStream.h"
+
+#include <cstring>
+
+static const int TAG_BITS = 2;
+static const int COORD_BITS = 3;
+static const int DIR_BITS = 2;
+static const int COLOR_BITS = 3;
+static const int SPECIAL_BITS = 2;
+static const int SCORE_BITS = 32;
+static const int COUNT_GROUP = 4;
+
+static const uint32_t MAX_REFILLS = uint32_t(GRID_CELLS * MAX_CASCADE_STEPS);
+
+static const int SPECIAL_FLAGS[] = { 0, CELL_LINE_H, CELL_LINE_V, CELL_BOMB };
+
+// Direction from the first swapped cell to the second one
+static const int DIR_X[] = { 1, -1, 0, 0 };
+static const int DIR_Y[] = { 0, 0, 1, -1 };
+
+static const size_t READ_CHUNK = 4096;
+
+#pragma pack(push, 1)
+
+struct StreamHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint8_t gridWidth;
+	uint8_t gridHeight;
+	uint8_t colorBits;
+	uint8_t reserved;
+};
+
+#pragma pack(pop)
+
+// Little-endian bit string, as in puzzle packs
+class BitWriter
+{
+public:
+	explicit BitWriter(std::vector<uint8_t>& out) : m_out(out), m_bit(0) { }
+
+	void Put(uint32_t value, int bits)
+	{
+		for (int i = 0; i < bits; ++i, ++m_bit)
+		{
+			if (m_bit % 8 == 0) m_out.push_back(0);
+			if ((value >> i) & 1) m_out.back() |= uint8_t(1 << (m_bit % 8));
+		}
+	}
+
+	// COUNT_GROUP bits at a time, each group followed by a continue bit
+	void PutCount(uint32_t value)
+	{
+		do
+		{
+			Put(value, COUNT_GROUP);
+			value >>= COUNT_GROUP;
+			Put(value != 0, 1);
+		}
+		while (value);
+	}
+
+private:
+	std::vector<uint8_t>& m_out;
+	int m_bit;
+};
+
+class BitReader
+{
+public:
+	BitReader(const uint8_t* data, size_t size) : m_data(data), m_bits(size * 8), m_bit(0) { }
+
+	bool Get(uint32_t& value, int bits)
+	{
+		if (m_bit + size_t(bits) > m_bits) return false;
+
+		value = 0;
+		for (int i = 0; i < bits; ++i, ++m_bit)
+			value |= uint32_t((m_data[m_bit / 8] >> (m_bit % 8)) & 1) << i;
+
+		return true;
+	}
+
+	// False until the whole count has arrived; overflow is set when it goes
+	// on past 32 bits, which no writer produces
+	bool GetCount(uint32_t& value, bool& overflow)
+	{
+		value = 0;
+		overflow = false;
+
+		for (int shift = 0; shift < 32; shift += COUNT_GROUP)
+		{
+			uint32_t group, more;
+			if (!Get(group, COUNT_GROUP) || !Get(more, 1)) return false;
+
+			value |= group << shift;
+			if (!more) return true;
+		}
+
+		overflow = true;
+		return true;
+	}
+
+	// Bytes used so far, records are padded to a byte
+	size_t Bytes() const { return (m_bit + 7) / 8; }
+
+private:
+	const uint8_t* m_data;
+	size_t m_bits;
+	size_t m_bit;
+};
+
+static int SpecialKind(int cell)
+{
+	if (cell & CELL_LINE_H) return 1;
+	if (cell & CELL_LINE_V) return 2;
+	if (cell & CELL_BOMB) return 3;
+	return 0;
+}
+
+EventEncoder::EventEncoder()
+	: m_file(0)
+	, m_x1(0), m_y1(0), m_x2(0), m_y2(0)
+	, m_pending(false)
+	, m_moves(0)
+	, m_bytes(0)
+{
+	m_out.reserve(READ_CHUNK);
+	m_refills.reserve(GRID_CELLS * 4);
+}
+
+EventEncoder::~EventEncoder()
+{
+	Close();
+}
+
+bool EventEncoder::Open(const char* path)
+{
+	m_file = fopen(path, "wb");
+	if (!m_file) return false;
+
+	const StreamHeader header = { STREAM_MAGIC, STREAM_VERSION, GRID_WIDTH, GRID_HEIGHT, COLOR_BITS, 0 };
+	fwrite(&header, sizeof(header), 1, m_file);
+	fflush(m_file);
+
+	return true;
+}
+
+void EventEncoder::Close()
+{
+	if (!m_file) return;
+
+	Flush();
+
+	m_out.clear();
+	BitWriter bits(m_out);
+	bits.Put(StreamEvent::END, TAG_BITS);
+	Write();
+
+	fclose(m_file);
+	m_file = 0;
+}
+
+void EventEncoder::Keyframe(const GridSnapshot& snap)
+{
+	if (!m_file) return;
+
+	// Refills of a new game or puzzle are part of the keyframe
+	m_pending = false;
+	m_refills.clear();
+
+	m_out.clear();
+	BitWriter bits(m_out);
+	bits.Put(StreamEvent::KEYFRAME, TAG_BITS);
+	bits.Put(uint32_t(snap.score), SCORE_BITS);
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			bits.Put(uint32_t(CellColor(snap.cells[x][y])), COLOR_BITS);
+			bits.Put(uint32_t(SpecialKind(snap.cells[x][y])), SPECIAL_BITS);
+		}
+	}
+
+	Write();
+}
+
+bool EventEncoder::Flush()
+{
+	if (!m_file || !m_pending) return true;
+
+	if (m_refills.size() > MAX_REFILLS)
+	{
+		m_pending = false;
+		m_refills.clear();
+		return false;
+	}
+
+	int dir = 0;
+	while (m_x1 + DIR_X[dir] != m_x2 || m_y1 + DIR_Y[dir] != m_y2)
+		++dir;
+
+	m_out.clear();
+	BitWriter bits(m_out);
+	bits.Put(StreamEvent::SWAP, TAG_BITS);
+	bits.Put(uint32_t(m_x1), COORD_BITS);
+	bits.Put(uint32_t(m_y1), COORD_BITS);
+	bits.Put(uint32_t(dir), DIR_BITS);
+	bits.PutCount(uint32_t(m_refills.size()));
+
+	for (size_t i = 0; i < m_refills.size(); ++i)
+		bits.Put(m_refills[i], COLOR_BITS);
+
+	Write();
+
+	m_pending = false;
+	m_refills.clear();
+	++m_moves;
+	return true;
+}
+
+void EventEncoder::Swapped(int x1, int y1, int x2, int y2)
+{
+	Flush();
+
+	m_x1 = x1;
+	m_y1 = y1;
+	m_x2 = x2;
+	m_y2 = y2;
+	m_pending = true;
+}
+
+void EventEncoder::Refilled(int /*x*/, int /*y*/, int cell)
+{
+	if (m_pending)
+		m_refills.push_back(uint8_t(CellColor(cell)));
+}
+
+// Each record goes out in one write so viewers see it whole or not at all
+void EventEncoder::Write()
+{
+	fwrite(&m_out[0], 1, m_out.size(), m_file);
+	fflush(m_file);
+	m_bytes += m_out.size();
+}
+
+EventDecoder::EventDecoder()
+	: m_file(0)
+	, m_pos(0)
+	, m_header(false)
+	, m_corrupt(false)
+	, m_nextRefill(0)
+{
+	m_buffer.reserve(READ_CHUNK);
+	m_refills.reserve(GRID_CELLS * 4);
+}
+
+EventDecoder::~EventDecoder()
+{
+	if (m_file) fclose(m_file);
+}
+
+bool EventDecoder::Open(const char* path)
+{
+	m_file = fopen(path, "rb");
+	return m_file != 0;
+}
+
+bool EventDecoder::Poll()
+{
+	if (!m_file) return false;
+
+	// Drop consumed records before appending
+	m_buffer.erase(m_buffer.begin(), m_buffer.begin() + ptrdiff_t(m_pos));
+	m_pos = 0;
+
+	uint8_t chunk[READ_CHUNK];
+	size_t got;
+
+	while ((got = fread(chunk, 1, sizeof(chunk), m_file)) > 0)
+		m_buffer.insert(m_buffer.end(), chunk, chunk + got);
+
+	// Keep tailing past the current end of file
+	clearerr(m_file);
+
+	if (!m_header && m_buffer.size() >= sizeof(StreamHeader))
+	{
+		StreamHeader header;
+		memcpy(&header, &m_buffer[0], sizeof(header));
+
+		if (header.magic != STREAM_MAGIC || header.version != STREAM_VERSION ||
+			header.gridWidth != GRID_WIDTH || header.gridHeight != GRID_HEIGHT || header.colorBits != COLOR_BITS)
+		{
+			fclose(m_file);
+			m_file = 0;
+			return false;
+		}
+
+		m_pos = sizeof(header);
+		m_header = true;
+	}
+
+	return true;
+}
+
+bool EventDecoder::Next(StreamEvent& ev)
+{
+	if (!m_header || m_corrupt || m_pos >= m_buffer.size()) return false;
+
+	BitReader bits(&m_buffer[m_pos], m_buffer.size() - m_pos);
+	uint32_t tag;
+	if (!bits.Get(tag, TAG_BITS)) return false;
+
+	ev.type = StreamEvent::Type(tag);
+
+	if (tag == StreamEvent::KEYFRAME)
+	{
+		uint32_t score;
+		if (!bits.Get(score, SCORE_BITS)) return false;
+
+		for (int x = 0; x < GRID_WIDTH; ++x)
+		{
+			for (int y = 0; y < GRID_HEIGHT; ++y)
+			{
+				uint32_t clr, kind;
+				if (!bits.Get(clr, COLOR_BITS) || !bits.Get(kind, SPECIAL_BITS)) return false;
+				if (clr >= uint32_t(OBJ_COUNT)) return Fail();
+
+				ev.snap.cells[x][y] = uint8_t(int(clr) | SPECIAL_FLAGS[kind]);
+			}
+		}
+
+		ev.snap.score = int32_t(score);
+		ev.snap.rng = SeedRandom(score);
+		ev.snap.selX = -1;
+		ev.snap.selY = -1;
+	}
+	else if (tag == StreamEvent::SWAP)
+	{
+		uint32_t x, y, dir, count;
+		bool overflow;
+		if (!bits.Get(x, COORD_BITS) || !bits.Get(y, COORD_BITS) || !bits.Get(dir, DIR_BITS) || !bits.GetCount(count, overflow))
+			return false;
+		if (overflow || count > MAX_REFILLS) return Fail();
+
+		ev.x1 = int(x);
+		ev.y1 = int(y);
+		ev.x2 = ev.x1 + DIR_X[dir];
+		ev.y2 = ev.y1 + DIR_Y[dir];
+
+		if (ev.x2 < 0 || ev.x2 >= GRID_WIDTH || ev.y2 < 0 || ev.y2 >= GRID_HEIGHT)
+			return Fail();
+
+		m_refills.clear();
+		m_nextRefill = 0;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t clr;
+			if (!bits.Get(clr, COLOR_BITS)) return false;
+			if (clr >= uint32_t(OBJ_COUNT)) return Fail();
+			m_refills.push_back(uint8_t(clr));
+		}
+	}
+	else if (tag != StreamEvent::END)
+	{
+		return Fail();
+	}
+
+	m_pos += bits.Bytes();
+	return true;
+}
+
+bool EventDecoder::Fail()
+{
+	m_corrupt = true;
+	return false;
+}
+
+bool EventDecoder::NextRefill(int& cell)
+{
+	if (m_nextRefill >= m_refills.size()) return false;
+
+	cell = m_refills[m_nextRefill++];
+	return true;
+}
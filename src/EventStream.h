@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <vector>
+
+#include "Grid.h"
+
+// Live game stream: a header followed by bit-packed records, each padded to
+// a byte so a viewer tailing the file always resumes on a record boundary.
+// Only swaps and refill colors are sent; removals, drops and special tiles
+// follow from the board, so viewers replay them with their own Grid.
+//
+//   keyframe  tag, score, every cell as color and special kind
+//   swap      tag, cell, direction, refill count, a color per refilled cell
+//             (at most GRID_CELLS per cascade step, MAX_CASCADE_STEPS steps)
+//   end       tag
+
+const uint32_t STREAM_MAGIC = 0x5645454d; // "MEEV"
+const uint32_t STREAM_VERSION = 1;
+
+// Cascade steps one swap record covers; longer moves go out as a keyframe
+const int MAX_CASCADE_STEPS = 32;
+
+struct StreamEvent
+{
+	enum Type { KEYFRAME, SWAP, END };
+
+	Type type;
+	GridSnapshot snap;		// KEYFRAME
+	int x1, y1, x2, y2;		// SWAP
+};
+
+// Records the moves of one Grid and appends them to a file
+class EventEncoder : public GridEvents
+{
+public:
+	EventEncoder();
+	~EventEncoder();
+
+	bool Open(const char* path);
+	void Close();
+
+	bool Active() const { return m_file != 0; }
+
+	// Sends the whole board, after a new game, puzzle or undo
+	void Keyframe(const GridSnapshot& snap);
+	// Sends the move recorded since the last call, if any. False when its
+	// cascade ran past MAX_CASCADE_STEPS and the board needs a keyframe.
+	bool Flush();
+
+	virtual void Swapped(int x1, int y1, int x2, int y2);
+	virtual void Refilled(int x, int y, int cell);
+
+	uint64_t Moves() const { return m_moves; }
+	uint64_t Bytes() const { return m_bytes; }
+
+private:
+	void Write();
+
+	FILE* m_file;
+	std::vector<uint8_t> m_out;
+	std::vector<uint8_t> m_refills;
+	int m_x1, m_y1, m_x2, m_y2;
+	bool m_pending;
+	uint64_t m_moves;
+	uint64_t m_bytes;
+};
+
+// Tails a stream file and hands out complete records. The refill colors of
+// the last swap are queued for the viewer Grid, which takes them instead of
+// picking its own.
+class EventDecoder : public GridEvents
+{
+public:
+	EventDecoder();
+	~EventDecoder();
+
+	bool Open(const char* path);
+
+	// Reads whatever was appended since the last call
+	bool Poll();
+	// False until the next record has fully arrived, or for good once the
+	// stream turned out to be corrupt
+	bool Next(StreamEvent& ev);
+	// A record could never be valid: unknown tag, swap off the board, a
+	// color out of range or more refills than a swap record may carry
+	bool Corrupt() const { return m_corrupt; }
+	// More data is waiting behind the last record
+	bool Behind() const { return m_pos < m_buffer.size(); }
+
+	virtual bool NextRefill(int& cell);
+
+private:
+	bool Fail();
+
+	FILE* m_file;
+	std::vector<uint8_t> m_buffer;
+	size_t m_pos;
+	bool m_header;
+	bool m_corrupt;
+	std::vector<uint8_t> m_refills;
+	size_t m_nextRefill;
+};
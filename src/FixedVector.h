@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+// Vector with inline storage for at most N elements; never allocates
+template <typename T, size_t N>
+class FixedVector
+{
+public:
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	FixedVector() : m_size(0) { }
+
+	void push_back(const T& item)
+	{
+		assert(m_size < N);
+		m_items[m_size++] = item;
+	}
+
+	void clear() { m_size = 0; }
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	iterator begin() { return m_items; }
+	iterator end() { return m_items + m_size; }
+	const_iterator begin() const { return m_items; }
+	const_iterator end() const { return m_items + m_size; }
+
+	T& operator[](size_t i) { assert(i < m_size); return m_items[i]; }
+	const T& operator[](size_t i) const { assert(i < m_size); return m_items[i]; }
+
+private:
+	T m_items[N];
+	size_t m_size;
+};
@@ -0,0 +1,47 @@
+#include "Governor.h"
+
+static const double AVERAGE_WEIGHT = 0.1;
+static const double RESTORE_BELOW = 0.6;	// of the budget
+static const int HOLD_FRAMES = 30;
+static const int RESTORE_FRAMES = 120;
+
+FrameGovernor::FrameGovernor(double budgetMs)
+	: m_budget(budgetMs)
+	, m_average(0)
+	, m_level(QUALITY_FULL)
+	, m_hold(0)
+	, m_calm(0)
+{
+}
+
+bool FrameGovernor::Frame(double ms)
+{
+	if (m_budget <= 0)
+		return false;
+
+	m_average = m_average ? m_average + (ms - m_average) * AVERAGE_WEIGHT : ms;
+	m_calm = m_average < m_budget * RESTORE_BELOW ? m_calm + 1 : 0;
+
+	// Let the average catch up with the previous change first
+	if (m_hold > 0)
+	{
+		--m_hold;
+		return false;
+	}
+
+	Quality level = m_level;
+
+	if (m_average > m_budget && m_level + 1 < QUALITY_COUNT)
+		level = Quality(m_level + 1);
+	else if (m_calm >= RESTORE_FRAMES && m_level > QUALITY_FULL)
+		level = Quality(m_level - 1);
+
+	if (level == m_level)
+		return false;
+
+	m_level = level;
+	m_hold = HOLD_FRAMES;
+	m_calm = 0;
+
+	return true;
+}
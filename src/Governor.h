@@ -0,0 +1,35 @@
+#pragma once
+
+// Levels of animation work, from everything to the cheapest that still
+// shows what happened. Grid reads the level when it lays out a cascade.
+enum Quality
+{
+	QUALITY_FULL,
+	QUALITY_REDUCED,	// per-column refills, coarse scale steps, fewer particles
+	QUALITY_MINIMAL,	// coarser still, a few particles only
+	QUALITY_COUNT
+};
+
+// Keeps frame time within a budget. An exponential average of the time spent
+// per frame lowers the quality one level when it goes over the budget and
+// raises it again only after a long run well below it, so the level does not
+// flip back and forth around the threshold.
+class FrameGovernor
+{
+public:
+	// A budget of 0 keeps full quality
+	explicit FrameGovernor(double budgetMs);
+
+	// Feeds the time one frame took, returns true when the level changed
+	bool Frame(double ms);
+
+	Quality Level() const { return m_level; }
+	double Average() const { return m_average; }
+
+private:
+	double m_budget;
+	double m_average;
+	Quality m_level;
+	int m_hold;		// frames left before the level may change again
+	int m_calm;		// consecutive frames below the restore threshold
+};
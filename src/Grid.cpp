@@ -1,24 +1,33 @@
 #include "Grid.h"
+#include "AllocTracker.h"
 #include "Objects.h"
 #include "Animations.h"
+#include "Particles.h"
+#include "PuzzlePack.h"
 
 #include <SDL.h>
 #include <ctime>
 #include <algorithm>
 
-static const int MIN_RANGE = 3;
-
 static const SDL_Color SEL_COLOR   = { 255, 255, 255, SDL_ALPHA_OPAQUE };
 static const SDL_Color CLEAR_COLOR = {   0,   0,   0, SDL_ALPHA_OPAQUE };
 
+// Per quality level: scale steps of animated sprites (0 is exact) and the
+// share of burst particles in percent
+static const int SCALE_STEPS[QUALITY_COUNT] = { 0, 8, 4 };
+static const int BURST_DENSITY[QUALITY_COUNT] = { 100, 50, 15 };
+
 Grid::Grid(SDL_Renderer* rend, Objects& obj, Animations& anim, const SDL_Rect& pos)
 	: m_rend(rend)
 	, m_objects(obj)
 	, m_animations(anim)
+	, m_particles(NULL)
+	, m_events(NULL)
+	, m_quality(QUALITY_FULL)
 	, m_pos(pos)
 	, m_selection(false)
-	, m_accumDelay(0)
 	, m_score(0)
+	, m_rng(SeedRandom(uint32_t(time(NULL))))
 {
 	NewGame();
 }
@@ -27,10 +36,13 @@ Grid::Grid(SDL_Renderer* rend, Objects& obj, Animations& anim, const SDL_Rect& p
 	: m_rend(rend)
 	, m_objects(obj)
 	, m_animations(anim)
+	, m_particles(NULL)
+	, m_events(NULL)
+	, m_quality(QUALITY_FULL)
 	, m_pos(pos)
 	, m_selection(false)
-	, m_accumDelay(0)
 	, m_score(0)
+	, m_rng(SeedRandom(uint32_t(time(NULL))))
 {
 	SDL_zero(m_oldCells);
 	memcpy(m_cells, cells, sizeof(m_cells));
@@ -38,19 +50,58 @@ Grid::Grid(SDL_Renderer* rend, Objects& obj, Animations& anim, const SDL_Rect& p
 
 void Grid::NewGame()
 {
-	m_accumDelay = 0;
-
 	SDL_zero(m_oldCells);
 
 	for (int x = 0; x < GRID_WIDTH; ++x)
 		for (int y = 0; y < GRID_HEIGHT; ++y)
 			m_cells[x][y] = RND_CELL;
 
-	Randomize();	
+	Randomize(0);	
 
 	m_score = 0;
 }
 
+bool Grid::Load(const PuzzlePack& pack, size_t idx)
+{
+	TCells cells;
+	if (!pack.Decode(idx, cells)) return false;
+
+	m_selection = false;
+
+	SDL_zero(m_oldCells);
+	memcpy(m_cells, cells, sizeof(m_cells));
+
+	m_score = 0;
+	return true;
+}
+
+void Grid::Save(GridSnapshot& snap) const
+{
+	for (int x = 0; x < GRID_WIDTH; ++x)
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+			snap.cells[x][y] = uint8_t(m_cells[x][y]);
+
+	snap.score = m_score;
+	snap.rng = m_rng;
+	snap.selX = int8_t(m_selection ? m_selected.x : -1);
+	snap.selY = int8_t(m_selection ? m_selected.y : -1);
+}
+
+void Grid::Restore(const GridSnapshot& snap)
+{
+	for (int x = 0; x < GRID_WIDTH; ++x)
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+			m_cells[x][y] = snap.cells[x][y];
+
+	memcpy(m_oldCells, m_cells, sizeof(m_oldCells));
+
+	m_score = snap.score;
+	m_rng = snap.rng;
+	m_selection = snap.selX >= 0;
+	m_selected.x = snap.selX;
+	m_selected.y = snap.selY;
+}
+
 bool Grid::CellFromMouseCoord(int x, int y, SDL_Point& pt)
 {
 	const int gridX = x - m_pos.x;
@@ -80,6 +131,8 @@ bool Grid::Swap(int x, int y)
 {
 	if (!m_selection) return false;		
 
+	AllocScope scope(ALLOC_SWAP);
+
 	int dx = abs(m_selected.x - x);
 	int dy = abs(m_selected.y - y);
 
@@ -91,47 +144,53 @@ bool Grid::Swap(int x, int y)
 		return false;
 	}
 		
+	if (m_events && dx + dy == 1)
+		m_events->Swapped(m_selected.x, m_selected.y, x, y);
+
 	int& clr1 = m_cells[m_selected.x][m_selected.y];
 	int& clr2 = m_cells[x][y];
 
 	memcpy(m_oldCells, m_cells, sizeof(m_oldCells));
 
-	if (clr1 == clr2)
+	if (CellColor(clr1) == CellColor(clr2))
 	{
-		m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateSwap(*this, m_selected.x, m_selected.y, clr1, x, y, clr2, true, 0)));
+		m_animations.AddAnimation(new (m_animations) AnimateSwap(*this, m_selected.x, m_selected.y, clr1, x, y, clr2, true), 0);
 		return false;
 	}
 
 	std::swap(clr1, clr2);
 
-	m_accumDelay = AnimateSwap::DURATION;
+	// The whole cascade is laid out on the animation timeline from here
+	Uint32 ts = AnimateSwap::DURATION;
 
-	m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateSwap(*this, m_selected.x, m_selected.y, clr2, x, y, clr1, false, 0)));		
+	m_animations.AddAnimation(new (m_animations) AnimateSwap(*this, m_selected.x, m_selected.y, clr2, x, y, clr1, false), 0);		
 
 	TRanges ranges;
-	GetRemovedRanges(ranges);		
+	GetRemovedRanges(ranges, ts);		
 
 	if (ranges.empty())
 	{
 		std::swap(clr1, clr2);
-		m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateSwap(*this, m_selected.x, m_selected.y, clr2, x, y, clr1, false, m_accumDelay)));
+		m_animations.AddAnimation(new (m_animations) AnimateSwap(*this, m_selected.x, m_selected.y, clr2, x, y, clr1, false), ts);
 		return false;
 	}	
 
+	AllocScope cascade(ALLOC_CASCADE);
+
 	do
 	{
-		RemoveRanges(ranges);			
-		Randomize();			
+		ts += AnimateRemoval::DURATION;
+		ts = RemoveRanges(ranges, ts);			
+		ts = Randomize(ts);			
 	}
-	while (GetRemovedRanges(ranges));		
+	while (GetRemovedRanges(ranges, ts));		
 
 	return true;
 }
 
 void Grid::Redraw()
 {
-	SDL_SetRenderDrawColor(m_rend, CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
-	SDL_RenderFillRect(m_rend, &m_pos);
+	ClearRect(m_pos);
 
 	for (int x = 0; x < GRID_WIDTH; ++x)
 	{
@@ -146,8 +205,7 @@ void Grid::Redraw()
 
 void Grid::RedrawOld()
 {
-	SDL_SetRenderDrawColor(m_rend, CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
-	SDL_RenderFillRect(m_rend, &m_pos);
+	ClearRect(m_pos);
 
 	for (int x = 0; x < GRID_WIDTH; ++x)
 	{
@@ -166,8 +224,7 @@ void Grid::DrawSelection()
 
 	const SDL_Rect outline = { ObjectX(m_selected.x), ObjectY(m_selected.y),									   
 							   ObjectWidth(), ObjectHeight() };
-	SDL_SetRenderDrawColor(m_rend, SEL_COLOR.r, SEL_COLOR.g, SEL_COLOR.b, SEL_COLOR.a);
-	SDL_RenderDrawRect(m_rend, &outline);
+	m_objects.DrawRect(m_rend, outline, SEL_COLOR);
 }
 
 void Grid::ClearSelection()
@@ -177,15 +234,14 @@ void Grid::ClearSelection()
 	const SDL_Rect outline = { ObjectX(m_selected.x), ObjectY(m_selected.y),									   
 							   ObjectWidth(), ObjectHeight() };
 
-	SDL_SetRenderDrawColor(m_rend, CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
-	SDL_RenderFillRect(m_rend, &outline);
+	ClearRect(outline);
 
 	DrawObject(outline.x, outline.y, m_cells[m_selected.x][m_selected.y]);
 		
 	m_selection = false;
 }
 
-void Grid::RemoveRanges(const TRanges& ranges)
+Uint32 Grid::RemoveRanges(const TRanges& ranges, Uint32 ts)
 {
 	TRanges::const_iterator it = ranges.begin();
 
@@ -206,11 +262,11 @@ void Grid::RemoveRanges(const TRanges& ranges)
 			const Uint32 animLen = len * AnimateSlide::STEP_DURATION;
 
 			if (prevX == r.x)
-				m_accumDelay += animLen;
+				ts += animLen;
 
 			maxAnimLen = std::max(animLen, maxAnimLen);
 
-			m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateSlide(*this, r.x, r.y1, r.y2, &m_cells[r.x][len], animLen, m_accumDelay)));
+			m_animations.AddAnimation(new (m_animations) AnimateSlide(*this, r.x, r.y1, r.y2, &m_cells[r.x][len], animLen), ts);
 			addDelay = true;
 		}
 
@@ -221,7 +277,9 @@ void Grid::RemoveRanges(const TRanges& ranges)
 	}
 
 	if (addDelay)
-		m_accumDelay += maxAnimLen;
+		ts += maxAnimLen;
+
+	return ts;
 }
 
 bool Grid::CanRemove(int x, int y)
@@ -229,146 +287,288 @@ bool Grid::CanRemove(int x, int y)
 	int xcount = 0;
 	int ycount = 0;
 
-	const int clr = m_cells[x][y];
+	const int clr = CellColor(m_cells[x][y]);
 
 	for (int i = x; i >= std::max(0, x - MIN_RANGE + 1); --i)
-		if (m_cells[i][y] == clr) ++xcount; else break;
+		if (CellColor(m_cells[i][y]) == clr) ++xcount; else break;
 
 	for (int i = x; i < std::min(GRID_WIDTH, x + MIN_RANGE); ++i)
-		if (m_cells[i][y] == clr) ++xcount; else break;
+		if (CellColor(m_cells[i][y]) == clr) ++xcount; else break;
 
 	if (xcount >= MIN_RANGE) return true;
 
 	for (int i = y; i >= std::max(0, y - MIN_RANGE + 1); --i)
-		if (m_cells[x][i] == clr) ++ycount; else break;
+		if (CellColor(m_cells[x][i]) == clr) ++ycount; else break;
 
 	for (int i = y; i < std::min(GRID_HEIGHT, y + MIN_RANGE); ++i)
-		if (m_cells[x][i] == clr) ++ycount; else break;
+		if (CellColor(m_cells[x][i]) == clr) ++ycount; else break;
 
 	if (ycount >= MIN_RANGE) return true;
 
 	return false;
 }
 
-void Grid::Randomize()
+// Below full quality a run of refilled cells grows in as one animation
+// instead of one per cell
+Uint32 Grid::Randomize(Uint32 ts)
 {
-	srand((unsigned)time(NULL));
-
 	bool addDelay = false;
 
 	for (int x = 0; x < GRID_WIDTH; ++x)
 	{
 		for (int y = 0; y < GRID_HEIGHT; ++y)
 		{
-			if (m_cells[x][y] == RND_CELL)
-			{
-				m_score += 10;
+			if (m_cells[x][y] != RND_CELL) continue;
 
-				do
-				{
-					m_cells[x][y] = rand() % OBJ_COUNT;					
-				}
-				while (CanRemove(x, y));
+			int y2 = y;
+			for (; y2 < GRID_HEIGHT && m_cells[x][y2] == RND_CELL; ++y2)
+				Refill(x, y2);
 
-				m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateAddition(*this, x, y, 1, 1, 0, m_cells[x][y], m_accumDelay)));
-				addDelay = true;
+			if (m_quality == QUALITY_FULL)
+			{
+				for (int i = y; i < y2; ++i)
+					m_animations.AddAnimation(new (m_animations) AnimateAddition(*this, x, i, 1, 1, 0, m_cells[x][i]), ts);
 			}
+			else
+			{
+				m_animations.AddAnimation(new (m_animations) AnimateColumnAddition(*this, x, y, y2 - 1, &m_cells[x][y]), ts);
+			}
+
+			addDelay = true;
+			y = y2 - 1;
 		}
 	}
 
 	if (addDelay)
-		m_accumDelay += AnimateScaling::DURATION;
+		ts += AnimateScaling::DURATION;
+
+	return ts;
 }
 
-int Grid::GetRemovedRanges(TRanges& out)
+void Grid::Refill(int x, int y)
 {
-	TRanges ranges;
+	m_score += CELL_SCORE;
+
+	if (!m_events || !m_events->NextRefill(m_cells[x][y]))
+	{
+		do
+		{
+			m_cells[x][y] = int(NextRandom(m_rng) % OBJ_COUNT);					
+		}
+		while (CanRemove(x, y));
+	}
+
+	if (m_events)
+		m_events->Refilled(x, y, m_cells[x][y]);
+}
+
+void Grid::Burst(int x, int y, int w, int h, int clr, Uint32 ts)
+{
+	if (!m_particles)
+		return;
+
+	SDL_Rect rc = { ObjectX(x), ObjectY(y), w * ObjectWidth(), h * ObjectHeight() };
+	const int count = std::max(1, w * h * Particles::PER_CELL * BURST_DENSITY[m_quality] / 100);
+	m_particles->Burst(rc, CellColor(clr), count, ts);
+}
+
+int Grid::GetRemovedRanges(TRanges& out, Uint32 ts)
+{
+	struct Special
+	{
+		int x, y;
+		int flag;
+	};
+
+	TMarks removed;
+	SDL_zero(removed);
+
+	// Long runs leave a special tile in their middle
+	FixedVector<Special, GRID_WIDTH * GRID_HEIGHT> created;
 
 	for (int x = 0; x < GRID_WIDTH; ++x)
 	{
 		int yStart = 0, y = 1;
 
-		for (; y < GRID_HEIGHT; ++y)
+		for (; y <= GRID_HEIGHT; ++y)
 		{
-			if (m_cells[x][yStart] == m_cells[x][y])
+			if (y < GRID_HEIGHT && CellColor(m_cells[x][yStart]) == CellColor(m_cells[x][y]))
 				continue;
 				
-			if ((y - yStart) >= MIN_RANGE)
+			const int len = y - yStart;
+
+			if (len >= MIN_RANGE)
 			{
-				Range r = { x, yStart, y - 1 };
-				ranges.push_back(r);
-				m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateVertRemoval(*this, x, yStart, y - yStart, m_cells[x][yStart], m_accumDelay)));
+				for (int i = yStart; i < y; ++i)
+					removed[x][i] = true;
+
+				if (len >= LINE_RANGE)
+				{
+					const Special sp = { x, yStart + len / 2, len >= BOMB_RANGE ? CELL_BOMB : CELL_LINE_V };
+					created.push_back(sp);
+				}
 			}
 				
 			yStart = y;				
 		}
-
-		if ((y - yStart) >= MIN_RANGE)
-		{
-			Range r = { x, yStart, y - 1 };
-			ranges.push_back(r);
-			m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateVertRemoval(*this, x, yStart, y - yStart, m_cells[x][yStart], m_accumDelay)));
-		}
 	}
 
 	for (int y = 0; y < GRID_HEIGHT; ++y)
 	{
 		int xStart = 0, x = 1;
 
-		for (; x < GRID_WIDTH; ++x)
+		for (; x <= GRID_WIDTH; ++x)
 		{
-			if (m_cells[xStart][y] == m_cells[x][y])
+			if (x < GRID_WIDTH && CellColor(m_cells[xStart][y]) == CellColor(m_cells[x][y]))
 				continue;
 				
-			if ((x - xStart) >= MIN_RANGE)
+			const int len = x - xStart;
+
+			if (len >= MIN_RANGE)
 			{
 				for (int i = xStart; i < x; ++i)
+					removed[i][y] = true;
+
+				if (len >= LINE_RANGE)
 				{
-					Range r = { i, y, y };
-					ranges.push_back(r);						
+					const Special sp = { xStart + len / 2, y, len >= BOMB_RANGE ? CELL_BOMB : CELL_LINE_H };
+					created.push_back(sp);
 				}
-
-				m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateHorzRemoval(*this, xStart, y, x - xStart, m_cells[xStart][y], m_accumDelay)));
 			}
 
 			xStart = x;
 		}
+	}
+
+	ResolveSpecials(removed);
+
+	for (size_t i = 0; i < created.size(); ++i)
+	{
+		const Special& sp = created[i];
+		removed[sp.x][sp.y] = false;
+		m_cells[sp.x][sp.y] = CellColor(m_cells[sp.x][sp.y]) | sp.flag;
+	}
+
+	// Overlapping matches and effects merge for free: ranges are the runs of
+	// removed cells per column, animated in runs of equal cells
+	out.clear();
 
-		if ((x - xStart) >= MIN_RANGE)
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
 		{
-			for (int i = xStart; i < x; ++i)
+			if (!removed[x][y]) continue;
+
+			Range r = { x, y, y };
+			while (r.y2 + 1 < GRID_HEIGHT && removed[x][r.y2 + 1])
+				++r.y2;
+
+			out.push_back(r);
+
+			for (int yStart = r.y1; yStart <= r.y2; )
 			{
-				Range r = { i, y, y };
-				ranges.push_back(r);
+				int yEnd = yStart + 1;
+				while (yEnd <= r.y2 && m_cells[x][yEnd] == m_cells[x][yStart])
+					++yEnd;
+
+				m_animations.AddAnimation(new (m_animations) AnimateVertRemoval(*this, x, yStart, yEnd - yStart, m_cells[x][yStart]), ts);
+				Burst(x, yStart, 1, yEnd - yStart, m_cells[x][yStart], ts);
+				yStart = yEnd;
 			}
 
-			m_animations.AddAnimation(std::auto_ptr<Animation>(new AnimateHorzRemoval(*this, xStart, y, x - xStart, m_cells[xStart][y], m_accumDelay)));
+			y = r.y2;
 		}
 	}
 
-	sort(ranges.begin(), ranges.end());
+	return int(out.size());
+}
 
-	TRanges::iterator it = ranges.begin();
-	while (it != ranges.end() && it != (--ranges.end()))
-	{
-		Range& cur = *it;
-		Range& next = *(++it);
+// Chain reaction over a worklist: every cell is marked and queued at most
+// once and each color is bombed at most once, so the cost is linear in the
+// number of cleared cells whatever the chain looks like.
+void Grid::ResolveSpecials(TMarks& removed)
+{
+	FixedVector<SDL_Point, GRID_WIDTH * GRID_HEIGHT> work;
 
-		if (cur.x == next.x && cur.y2 >= next.y1)
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
 		{
-			cur.y1 = std::min(cur.y1, next.y1);
-			cur.y2 = std::max(cur.y2, next.y2);
-			it = ranges.erase(it);
-			--it;
+			if (removed[x][y] && (m_cells[x][y] & CELL_SPECIAL))
+			{
+				const SDL_Point pt = { x, y };
+				work.push_back(pt);
+			}
 		}
 	}
 
-	out.swap(ranges);
+	if (work.empty()) return;
 
-	if (out.size())
-		m_accumDelay += AnimateRemoval::DURATION;
+	// Cells by color, built on the first bomb
+	FixedVector<SDL_Point, GRID_WIDTH * GRID_HEIGHT> colors[CELL_COLOR_MASK + 1];
+	bool bucketed = false;
+	bool bombed[CELL_COLOR_MASK + 1] = { false };
 
-	return out.size();
+	for (size_t next = 0; next < work.size(); ++next)
+	{
+		const SDL_Point src = work[next];
+		const int cell = m_cells[src.x][src.y];
+
+		SDL_Point line[GRID_WIDTH + GRID_HEIGHT];
+		const SDL_Point* begin = line;
+		const SDL_Point* end = line;
+
+		if (cell & CELL_LINE_H)
+		{
+			for (int x = 0; x < GRID_WIDTH; ++x)
+			{
+				const SDL_Point pt = { x, src.y };
+				line[x] = pt;
+			}
+
+			end = line + GRID_WIDTH;
+		}
+		else if (cell & CELL_LINE_V)
+		{
+			for (int y = 0; y < GRID_HEIGHT; ++y)
+			{
+				const SDL_Point pt = { src.x, y };
+				line[y] = pt;
+			}
+
+			end = line + GRID_HEIGHT;
+		}
+		else if ((cell & CELL_BOMB) && !bombed[CellColor(cell)])
+		{
+			if (!bucketed)
+			{
+				for (int x = 0; x < GRID_WIDTH; ++x)
+				{
+					for (int y = 0; y < GRID_HEIGHT; ++y)
+					{
+						const SDL_Point pt = { x, y };
+						colors[CellColor(m_cells[x][y])].push_back(pt);
+					}
+				}
+
+				bucketed = true;
+			}
+
+			bombed[CellColor(cell)] = true;
+			begin = colors[CellColor(cell)].begin();
+			end = colors[CellColor(cell)].end();
+		}
+
+		for (const SDL_Point* pt = begin; pt != end; ++pt)
+		{
+			if (removed[pt->x][pt->y]) continue;
+
+			removed[pt->x][pt->y] = true;
+
+			if (m_cells[pt->x][pt->y] & CELL_SPECIAL)
+				work.push_back(*pt);
+		}
+	}
 }
 
 void Grid::DrawObject(int x, int y, int idx, double scale)
@@ -376,6 +576,12 @@ void Grid::DrawObject(int x, int y, int idx, double scale)
 	m_objects.DrawTexture(m_rend, x, y, ObjectWidth(), ObjectHeight(), idx, scale);
 }
 
+double Grid::QuantizeScale(double scale) const
+{
+	const int steps = SCALE_STEPS[m_quality];
+	return steps ? double(int(scale * steps + 0.5)) / steps : scale;
+}
+
 void Grid::Move(const SDL_Rect& pos, bool redraw)
 {
 	m_pos = pos;
@@ -390,6 +596,5 @@ void Grid::ClearRect(const SDL_Rect& rc)
 
 void Grid::ClearRect(const SDL_Rect& rc, const SDL_Color& clr)
 {
-	SDL_SetRenderDrawColor(m_rend, clr.r, clr.g, clr.b, clr.a);
-	SDL_RenderFillRect(m_rend, &rc);
+	m_objects.FillRect(m_rend, rc, clr);
 }
\ No newline at end of file
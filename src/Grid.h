@@ -1,15 +1,38 @@
 #pragma once
 
 #include <SDL_rect.h>
-#include <vector>
+#include "Board.h"
+#include "FixedVector.h"
+#include "Governor.h"
 
 class Objects;
 class Animations;
+class PuzzlePack;
+class Particles;
 struct SDL_Renderer;
 
-const int GRID_WIDTH  = 8;
-const int GRID_HEIGHT = 8;
-const int RND_CELL = -1;
+// Everything needed to put a Grid back into a saved state, without animations
+struct GridSnapshot
+{
+	TBoardCells cells;
+	int32_t score;
+	uint32_t rng;
+	int8_t selX;	// -1 without a selection
+	int8_t selY;
+};
+
+// Hooks for streaming a game: a recorder sees every swap and refilled cell,
+// a viewer can hand out the refill colors instead of the Grid picking them
+class GridEvents
+{
+public:
+	virtual ~GridEvents() { }
+
+	virtual void Swapped(int /*x1*/, int /*y1*/, int /*x2*/, int /*y2*/) { }
+	virtual void Refilled(int /*x*/, int /*y*/, int /*cell*/) { }
+	// False lets the Grid pick the color itself
+	virtual bool NextRefill(int& /*cell*/) { return false; }
+};
 
 class Grid
 {
@@ -18,7 +41,16 @@ public:
 	Grid(SDL_Renderer* rend, Objects& obj, Animations& anim, const SDL_Rect& pos, int cells[GRID_WIDTH][GRID_HEIGHT]);
 
 	void NewGame();
+	// False, leaving the grid as it was, when the pack board is invalid
+	bool Load(const PuzzlePack& pack, size_t idx);
 	int GetScore() { return m_score; }
+	const TCells& Cells() const { return m_cells; }
+
+	void Save(GridSnapshot& snap) const;
+	void Restore(const GridSnapshot& snap);
+	void SetParticles(Particles* particles) { m_particles = particles; }
+	void SetEvents(GridEvents* events) { m_events = events; }
+	void SetQuality(Quality quality) { m_quality = quality; }
 
 	bool CellFromMouseCoord(int x, int y, SDL_Point& pt);
 	void Select(int x, int y);
@@ -34,6 +66,8 @@ public:
 	int ObjectHeight() { return m_pos.h / GRID_HEIGHT; }
 
 	void DrawObject(int x, int y, int idx, double scale = 1);
+	// Rounds an animated scale to the steps the current quality allows
+	double QuantizeScale(double scale) const;
 
 	void Move(const SDL_Rect& pos, bool redraw = true);
 
@@ -49,28 +83,32 @@ private:
 		int x;
 		int y1;
 		int y2;
-
-		bool operator<(const Range& r) const
-		{
-			return (x < r.x) || (x == r.x && y1 < r.y1);
-		}
 	};
 
-	typedef std::vector<Range> TRanges;
+	// Column runs of removed cells; a board has fewer runs than cells
+	typedef FixedVector<Range, GRID_WIDTH * GRID_HEIGHT> TRanges;
+	typedef bool TMarks[GRID_WIDTH][GRID_HEIGHT];
 
-	void RemoveRanges(const TRanges& ranges);
+	// Cascade steps take the timeline position they start at and return where they end
+	Uint32 RemoveRanges(const TRanges& ranges, Uint32 ts);
 	bool CanRemove(int x, int y);
-	void Randomize();
-	int GetRemovedRanges(TRanges& out);
+	Uint32 Randomize(Uint32 ts);
+	void Refill(int x, int y);
+	int GetRemovedRanges(TRanges& out, Uint32 ts);
+	void ResolveSpecials(TMarks& removed);
+	void Burst(int x, int y, int w, int h, int clr, Uint32 ts);
 
 	SDL_Renderer* m_rend;
 	Objects& m_objects;
 	Animations& m_animations;
+	Particles* m_particles;
+	GridEvents* m_events;
+	Quality m_quality;
 	SDL_Rect m_pos;
-	int m_oldCells[GRID_WIDTH][GRID_HEIGHT];
-	int m_cells[GRID_WIDTH][GRID_HEIGHT];
+	TCells m_oldCells;
+	TCells m_cells;
 	SDL_Point m_selected;
 	bool m_selection;
-	Uint32 m_accumDelay;
 	int m_score;
+	uint32_t m_rng;
 };
\ No newline at end of file
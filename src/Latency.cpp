@@ -0,0 +1,55 @@
+#include "Latency.h"
+
+#include <SDL.h>
+
+LatencyMeter::LatencyMeter()
+	: m_freq(SDL_GetPerformanceFrequency())
+	, m_inputTS(0)
+	, m_handledTS(0)
+{
+}
+
+void LatencyMeter::Input(Uint64 ts)
+{
+	m_inputTS = ts;
+	m_handledTS = 0;
+}
+
+void LatencyMeter::Handled()
+{
+	if (!m_inputTS) return;
+
+	m_handledTS = SDL_GetPerformanceCounter();
+	m_handled.Add(Ms(m_inputTS, m_handledTS));
+}
+
+void LatencyMeter::Presented()
+{
+	if (!m_inputTS || !m_handledTS) return;
+
+	m_presented.Add(Ms(m_inputTS, SDL_GetPerformanceCounter()));
+	m_inputTS = 0;
+}
+
+double LatencyMeter::Report()
+{
+	if (m_presented.Empty())
+	{
+		SDL_Log("latency: no samples");
+		return 0;
+	}
+
+	const double p99 = m_presented.Get(99);
+
+	SDL_Log("latency: %u clicks, input->update p50 %.3f ms p99 %.3f ms, input->present p50 %.3f ms p99 %.3f ms",
+			unsigned(m_presented.Count()),
+			m_handled.Get(50), m_handled.Get(99),
+			m_presented.Get(50), p99);
+
+	return p99;
+}
+
+double LatencyMeter::Ms(Uint64 from, Uint64 to) const
+{
+	return double(to - from) * 1000.0 / double(m_freq);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+#include "Stats.h"
+
+// Measures time from a mouse click reaching the main loop to the first
+// SDL_RenderPresent that shows its result.
+class LatencyMeter
+{
+public:
+	LatencyMeter();
+
+	void Input(Uint64 ts);
+	void Handled();
+	void Presented();
+
+	bool Pending() const { return m_inputTS != 0; }
+
+	// Logs p50/p99 of the session and returns p99 of input-to-present in ms
+	double Report();
+
+private:
+	double Ms(Uint64 from, Uint64 to) const;
+
+	Uint64 m_freq;
+	Uint64 m_inputTS;
+	Uint64 m_handledTS;
+	Percentiles m_handled;
+	Percentiles m_presented;
+};
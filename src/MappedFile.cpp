@@ -0,0 +1,125 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile()
+	: m_data(0)
+	, m_size(0)
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(0)
+{
+}
+
+bool MappedFile::Open(const char* path, size_t size, bool create)
+{
+	Close();
+
+	m_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+						 create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize)) { Close(); return false; }
+
+	if (size == 0)
+		size = size_t(fileSize.QuadPart);
+
+	if (size == 0) { Close(); return false; }
+
+	const ULONGLONG mapSize = ULONGLONG(size) > ULONGLONG(fileSize.QuadPart) ? ULONGLONG(size) : ULONGLONG(fileSize.QuadPart);
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, DWORD(mapSize >> 32), DWORD(mapSize), NULL);
+	if (!m_mapping) { Close(); return false; }
+
+	m_data = MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!m_data) { Close(); return false; }
+
+	m_size = size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+
+	m_data = 0;
+	m_size = 0;
+	m_mapping = 0;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Flush(bool async)
+{
+	if (!m_data) return;
+
+	FlushViewOfFile(m_data, m_size);
+	if (!async) FlushFileBuffers(m_file);
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_data(0)
+	, m_size(0)
+	, m_fd(-1)
+{
+}
+
+bool MappedFile::Open(const char* path, size_t size, bool create)
+{
+	Close();
+
+	m_fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0644);
+	if (m_fd < 0) return false;
+
+	struct stat st;
+	if (fstat(m_fd, &st)) { Close(); return false; }
+
+	if (size == 0)
+		size = size_t(st.st_size);
+	else if (off_t(size) > st.st_size && ftruncate(m_fd, off_t(size)))
+		{ Close(); return false; }
+
+	if (size == 0) { Close(); return false; }
+
+	void* data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) { Close(); return false; }
+
+	m_data = data;
+	m_size = size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data) munmap(m_data, m_size);
+	if (m_fd >= 0) close(m_fd);
+
+	m_data = 0;
+	m_size = 0;
+	m_fd = -1;
+}
+
+void MappedFile::Flush(bool async)
+{
+	if (m_data) msync(m_data, m_size, async ? MS_ASYNC : MS_SYNC);
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-write memory mapping of a whole file. Mapping a file under /dev/shm
+// (Linux) gives plain shared memory between local processes.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// size == 0 maps the existing file as is, otherwise the file is grown
+	// (or created when create is set) to at least size bytes
+	bool Open(const char* path, size_t size, bool create);
+	void Close();
+
+	void* Data() { return m_data; }
+	const void* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+	// Schedules (async) or performs a write-back of dirty pages
+	void Flush(bool async);
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	void* m_data;
+	size_t m_size;
+#if defined(_WIN32)
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_fd;
+#endif
+};
@@ -1,18 +1,105 @@
+#include "AllocTracker.h"
 #include "Animations.h"
+#include "Capture.h"
+#include "EventStream.h"
+#include "Governor.h"
 #include "Objects.h"
 #include "Grid.h"
+#include "Latency.h"
+#include "MappedFile.h"
+#include "Observation.h"
+#include "Particles.h"
+#include "PuzzlePack.h"
+#include "Session.h"
+#include "Stats.h"
+#include "UndoRing.h"
+#include "Wall.h"
 
 #include <SDL.h>
 #include <SDL_image.h>
+#include <cstring>
 
 static const char WINDOW_CAPTION[] = "Midas Miner";
 static const SDL_Color CLEAR_COLOR = {   0,   0,   0, SDL_ALPHA_OPAQUE };
-static const Uint32 GAME_LEN = 60000; // 60 sec
+static const Uint32 AUTOCLICK_INTERVAL = 20;
+static const Uint32 SESSION_SAVE_INTERVAL = 1000;
+static const Uint32 OBS_RING_SLOTS = 1024;
+static const int CAPTURE_SLOTS = 8;
+static const int WALL_WIDTH = 1280;
+static const int WALL_HEIGHT = 960;
+static const Uint32 WALL_FRAME_MS = 16;
+static const size_t UNDO_DEPTH = 64;
+static const double FRAME_BUDGET_MS = 16.7;
+
+struct Options
+{
+	bool latency;
+	int autoClicks;
+	double latencyBudget;
+	const char* obsPath;
+	const char* puzzlePath;
+	int puzzleIndex;
+	const char* capturePath;
+	int wall;
+	const char* broadcastPath;
+	const char* spectatePath;
+	double frameBudget;
+	const char* sessionPath;
+};
+
+static bool ParseOptions(int argc, char* argv[], Options& opt)
+{
+	SDL_zero(opt);
+	opt.frameBudget = FRAME_BUDGET_MS;
 
-void ClearWindow(SDL_Renderer* rend)
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-latency"))
+			opt.latency = true;
+		else if (!strcmp(argv[i], "-autoclick") && i + 1 < argc)
+			opt.autoClicks = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-latency-budget") && i + 1 < argc)
+			opt.latencyBudget = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-export-obs") && i + 1 < argc)
+			opt.obsPath = argv[++i];
+		else if (!strcmp(argv[i], "-puzzle") && i + 2 < argc)
+		{
+			opt.puzzlePath = argv[++i];
+			opt.puzzleIndex = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-capture") && i + 1 < argc)
+			opt.capturePath = argv[++i];
+		else if (!strcmp(argv[i], "-wall") && i + 1 < argc)
+			opt.wall = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-broadcast") && i + 1 < argc)
+			opt.broadcastPath = argv[++i];
+		else if (!strcmp(argv[i], "-spectate") && i + 1 < argc)
+			opt.spectatePath = argv[++i];
+		else if (!strcmp(argv[i], "-frame-budget") && i + 1 < argc)
+			opt.frameBudget = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-session") && i + 1 < argc)
+			opt.sessionPath = argv[++i];
+		else
+			return false;
+	}
+
+	if (opt.autoClicks > 0 || opt.latencyBudget > 0)
+		opt.latency = true;
+
+	return true;
+}
+
+void ClearWindow(SDL_Renderer* rend, Objects& objects)
+{
+	objects.Clear(rend, CLEAR_COLOR);
+}
+
+void Present(SDL_Renderer* rend, Objects& objects, FrameCapture& capture)
 {
-	SDL_SetRenderDrawColor(rend, CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, CLEAR_COLOR.a);
-	SDL_RenderClear(rend);
+	AllocScope scope(ALLOC_PRESENT);
+	objects.Flush();
+	capture.Frame();
+	SDL_RenderPresent(rend);
 }
 
 void GetGridRect(SDL_Window* win, SDL_Rect* gridPos)
@@ -34,17 +121,301 @@ void GetGridRect(SDL_Window* win, SDL_Rect* gridPos)
 
 static Uint32 END_GAME_EVENT;
 
-static Uint32 TimerCallback(Uint32 interval, void *param)
+// The first game may be a resumed one, the following ones are full length
+static Uint32 TimerCallback(Uint32 /*interval*/, void * /*param*/)
 {
 	SDL_Event event;
 	SDL_zero(event);
 	event.type = END_GAME_EVENT;
 	SDL_PushEvent(&event);
+	return GAME_LEN;
+}
+
+static void SaveSession(SessionFile& session, const Grid& grid, Uint32 gameStartTS)
+{
+	const Uint32 spent = SDL_GetTicks() - gameStartTS;
+
+	GridSnapshot snap;
+	grid.Save(snap);
+	session.Save(snap, spent < GAME_LEN ? GAME_LEN - spent : 0);
+}
+
+static Uint32 SESSION_SAVE_EVENT;
+
+// Moves save the session too; this keeps the game time current between them
+static Uint32 SessionSaveCallback(Uint32 interval, void * /*param*/)
+{
+	SDL_Event event;
+	SDL_zero(event);
+	event.type = SESSION_SAVE_EVENT;
+	SDL_PushEvent(&event);
 	return interval;
 }
 
+static Uint32 AUTOCLICK_EVENT;
+
+static Uint32 AutoClickCallback(Uint32 interval, void * /*param*/)
+{
+	SDL_Event event;
+	SDL_zero(event);
+	event.type = AUTOCLICK_EVENT;
+	SDL_PushEvent(&event);
+	return interval;
+}
+
+// Synthetic player: selects a random cell, then clicks one of its neighbours
+class AutoClicker
+{
+public:
+	AutoClicker(int clicks) : m_left(clicks), m_selected(false) { SDL_zero(m_cell); }
+
+	bool Done() const { return m_left <= 0; }
+
+	void Click(Grid& grid)
+	{
+		if (m_selected)
+		{
+			const int dir = rand() % 4;
+			m_cell.x = SDL_clamp(m_cell.x + (dir == 0) - (dir == 1), 0, GRID_WIDTH - 1);
+			m_cell.y = SDL_clamp(m_cell.y + (dir == 2) - (dir == 3), 0, GRID_HEIGHT - 1);
+		}
+		else
+		{
+			m_cell.x = rand() % GRID_WIDTH;
+			m_cell.y = rand() % GRID_HEIGHT;
+		}
+
+		m_selected = !m_selected;
+		--m_left;
+
+		SDL_Event event;
+		SDL_zero(event);
+		event.type = SDL_MOUSEBUTTONDOWN;
+		event.button.button = SDL_BUTTON_LEFT;
+		event.button.state = SDL_PRESSED;
+		event.button.x = grid.ObjectX(m_cell.x) + grid.ObjectWidth() / 2;
+		event.button.y = grid.ObjectY(m_cell.y) + grid.ObjectHeight() / 2;
+		SDL_PushEvent(&event);
+	}
+
+private:
+	int m_left;
+	bool m_selected;
+	SDL_Point m_cell;
+};
+
+// Feeds the time since start to the governor, true when the quality changed
+static bool Govern(FrameGovernor& governor, Uint64 start)
+{
+	const double ms = double(SDL_GetPerformanceCounter() - start) * 1000 / double(SDL_GetPerformanceFrequency());
+
+	if (!governor.Frame(ms))
+		return false;
+
+	SDL_Log("quality level %d, frame ms average %.2f", int(governor.Level()), governor.Average());
+	return true;
+}
+
+// Spectator mode: runs count bot boards until the window is closed
+static void RunWall(SDL_Window* win, SDL_Renderer* rend, Objects& objects, int count, double frameBudget)
+{
+	SDL_Rect pos = { 0, 0, 0, 0 };
+	SDL_GetWindowSize(win, &pos.w, &pos.h);
+
+	Wall wall(rend, objects, count, pos);
+	FrameGovernor governor(frameBudget);
+	Percentiles frameMs, drawCalls;
+	const double freq = double(SDL_GetPerformanceFrequency());
+
+	for (;;)
+	{
+		const Uint32 frameTS = SDL_GetTicks();
+		bool quit = false;
+
+		SDL_Event event;
+		while (SDL_PollEvent(&event))
+		{
+			if (event.type == SDL_QUIT)
+				quit = true;
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED)
+			{
+				SDL_GetWindowSize(win, &pos.w, &pos.h);
+				wall.Move(pos);
+			}
+		}
+
+		if (quit) break;
+
+		AllocTracker::EndFrame();
+		DrawCounter::Take();
+		const Uint64 start = SDL_GetPerformanceCounter();
+
+		{
+			AllocScope scope(ALLOC_DRAW);
+			ClearWindow(rend, objects);
+			wall.Draw();
+		}
+
+		{
+			AllocScope scope(ALLOC_PRESENT);
+			objects.Flush();
+			SDL_RenderPresent(rend);
+		}
+
+		frameMs.Add(double(SDL_GetPerformanceCounter() - start) * 1000 / freq);
+		drawCalls.Add(DrawCounter::Take());
+
+		if (Govern(governor, start))
+			wall.SetQuality(governor.Level());
+
+		const Uint32 spent = SDL_GetTicks() - frameTS;
+		if (spent < WALL_FRAME_MS)
+			SDL_Delay(WALL_FRAME_MS - spent);
+	}
+
+	if (!frameMs.Empty())
+	{
+		SDL_Log("wall: %d boards, %u frames, frame ms p50 %.3f p99 %.3f, draw calls/frame max %.0f",
+				count, unsigned(frameMs.Count()), frameMs.Get(50), frameMs.Get(99), drawCalls.Get(100));
+	}
+
+	AllocTracker::Report("wall");
+}
+
+static void SendKeyframe(EventEncoder& broadcast, const Grid& grid)
+{
+	GridSnapshot snap;
+	grid.Save(snap);
+	broadcast.Keyframe(snap);
+}
+
+// Viewer of a -broadcast stream: replays it with a local Grid until the
+// window is closed. Moves that arrived while busy are applied without animation.
+static bool RunSpectator(SDL_Window* win, SDL_Renderer* rend, Objects& objects, const char* path, double frameBudget)
+{
+	EventDecoder decoder;
+	if (!decoder.Open(path))
+		return false;
+
+	Animations anim;
+
+	SDL_Rect gridPos = { 0, 0, 0, 0 };
+	GetGridRect(win, &gridPos);
+
+	Grid grid(rend, objects, anim, gridPos);
+	grid.SetEvents(&decoder);
+
+	Particles particles;
+	grid.SetParticles(&particles);
+
+	FrameGovernor governor(frameBudget);
+	bool ended = false;
+	bool dirty = true;
+
+	for (;;)
+	{
+		const Uint32 frameTS = SDL_GetTicks();
+		bool quit = false;
+
+		SDL_Event event;
+		while (SDL_PollEvent(&event))
+		{
+			if (event.type == SDL_QUIT)
+				quit = true;
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED)
+			{
+				anim.Cancel();
+				particles.Clear();
+				GetGridRect(win, &gridPos);
+				grid.Move(gridPos, false);
+				dirty = true;
+			}
+		}
+
+		if (quit) break;
+
+		if (!anim.Active() && !ended)
+		{
+			if (!decoder.Poll())
+				return false;
+
+			StreamEvent ev;
+
+			while (decoder.Next(ev))
+			{
+				if (ev.type == StreamEvent::KEYFRAME)
+				{
+					grid.Restore(ev.snap);
+				}
+				else if (ev.type == StreamEvent::SWAP)
+				{
+					grid.Select(ev.x1, ev.y1);
+					grid.Swap(ev.x2, ev.y2);
+				}
+				else
+				{
+					SDL_Log("Broadcast ended, score %i", grid.GetScore());
+					ended = true;
+				}
+
+				dirty = true;
+
+				if (!decoder.Behind()) break;
+
+				anim.Cancel();
+				particles.Clear();
+			}
+
+			if (decoder.Corrupt())
+			{
+				SDL_Log("Corrupt stream %s", path);
+				return false;
+			}
+		}
+
+		if (dirty || anim.Active() || particles.Active())
+		{
+			const Uint64 start = SDL_GetPerformanceCounter();
+			ClearWindow(rend, objects);
+
+			if (anim.Active())
+			{
+				grid.RedrawOld();
+				anim.Draw(rend);
+			}
+			else
+			{
+				grid.Redraw();
+			}
+
+			particles.Update();
+			objects.Flush();
+			particles.Draw(rend);
+			SDL_RenderPresent(rend);
+
+			if (Govern(governor, start))
+				grid.SetQuality(governor.Level());
+
+			dirty = false;
+		}
+
+		const Uint32 spent = SDL_GetTicks() - frameTS;
+		if (spent < WALL_FRAME_MS)
+			SDL_Delay(WALL_FRAME_MS - spent);
+	}
+
+	return true;
+}
+
 int main(int argc, char* argv[])
 {
+	Options opt;
+	if (!ParseOptions(argc, argv, opt))
+	{
+		SDL_Log("Usage: %s [-latency] [-autoclick N] [-latency-budget MS] [-export-obs FILE] [-puzzle FILE INDEX] [-capture FILE] [-wall N] [-broadcast FILE] [-spectate FILE] [-frame-budget MS] [-session FILE]", argv[0]);
+		return -1;
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO))
 	{
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, WINDOW_CAPTION, SDL_GetError(), NULL);
@@ -81,8 +452,6 @@ int main(int argc, char* argv[])
 
 	SDL_SetWindowIcon(win, icon);
 
-	ClearWindow(rend);
-
 	Objects objects;
 	if (!objects.Load(rend))
 	{
@@ -90,47 +459,255 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
+	ClearWindow(rend, objects);
+
+	if (opt.wall > 0)
+	{
+		SDL_SetWindowSize(win, WALL_WIDTH, WALL_HEIGHT);
+		RunWall(win, rend, objects, opt.wall, opt.frameBudget);
+
+		SDL_FreeSurface(icon);
+		SDL_DestroyRenderer(rend);
+		SDL_DestroyWindow(win);
+		SDL_Quit();
+
+		return 0;
+	}
+
+	if (opt.spectatePath)
+	{
+		const bool ok = RunSpectator(win, rend, objects, opt.spectatePath, opt.frameBudget);
+		if (!ok)
+			SDL_Log("Cannot spectate %s", opt.spectatePath);
+
+		SDL_FreeSurface(icon);
+		SDL_DestroyRenderer(rend);
+		SDL_DestroyWindow(win);
+		SDL_Quit();
+
+		return ok ? 0 : -1;
+	}
+
 	Animations anim;
 
 	SDL_Rect gridPos = { 0, 0, 0, 0 };
 	GetGridRect(win, &gridPos);
 
 	Grid grid(rend, objects, anim, gridPos);
+
+	Particles particles;
+	grid.SetParticles(&particles);
+
+	PuzzlePack puzzles;
+	const bool puzzle = opt.puzzlePath != 0;
+
+	if (puzzle)
+	{
+		if (!puzzles.Open(opt.puzzlePath) || opt.puzzleIndex < 0 || unsigned(opt.puzzleIndex) >= puzzles.Count())
+		{
+			SDL_Log("No puzzle %i in %s", opt.puzzleIndex, opt.puzzlePath);
+			return -1;
+		}
+
+		if (!grid.Load(puzzles, size_t(opt.puzzleIndex)))
+		{
+			SDL_Log("Puzzle %i in %s is corrupt", opt.puzzleIndex, opt.puzzlePath);
+			return -1;
+		}
+
+		anim.Cancel();
+	}
+
+	SessionFile session;
+	uint32_t timeLeft = GAME_LEN;
+
+	if (opt.sessionPath)
+	{
+		if (!session.Open(opt.sessionPath))
+		{
+			SDL_Log("Cannot open session %s", opt.sessionPath);
+			return -1;
+		}
+
+		GridSnapshot snap;
+
+		if (session.Load(snap, timeLeft) && timeLeft > 0)
+		{
+			anim.Cancel();
+			grid.Restore(snap);
+			SDL_Log("Resumed session: score %i, %u ms left", grid.GetScore(), unsigned(timeLeft));
+		}
+		else
+		{
+			timeLeft = GAME_LEN;
+		}
+	}
+
+	MappedFile obsFile;
+	ObservationRing obsRing;
+	const bool exportObs = opt.obsPath != 0;
+
+	if (exportObs)
+	{
+		if (!obsFile.Open(opt.obsPath, ObservationRing::Size(OBS_RING_SLOTS), true) ||
+			!obsRing.Create(obsFile.Data(), obsFile.Size()))
+		{
+			SDL_Log("Cannot create observation ring %s", opt.obsPath);
+			return -1;
+		}
+
+		obsRing.Write(grid.Cells(), grid.GetScore());
+	}
+
+	EventEncoder broadcast;
+
+	if (opt.broadcastPath)
+	{
+		if (!broadcast.Open(opt.broadcastPath))
+		{
+			SDL_Log("Cannot broadcast to %s", opt.broadcastPath);
+			return -1;
+		}
+
+		grid.SetEvents(&broadcast);
+		SendKeyframe(broadcast, grid);
+	}
+
+	FrameCapture capture;
+
+	if (opt.capturePath && !capture.Start(rend, opt.capturePath, CAPTURE_SLOTS))
+	{
+		SDL_Log("Cannot capture to %s", opt.capturePath);
+		return -1;
+	}
+
 	grid.Redraw();
 
-	SDL_RenderPresent(rend);
+	Present(rend, objects, capture);
 
 	END_GAME_EVENT = SDL_RegisterEvents(1);
-	const SDL_TimerID idTimer = SDL_AddTimer(GAME_LEN, TimerCallback, 0);
+	const SDL_TimerID idTimer = SDL_AddTimer(timeLeft, TimerCallback, 0);
+	Uint32 gameStartTS = SDL_GetTicks() - (GAME_LEN - timeLeft);
+
+	SaveSession(session, grid, gameStartTS);
+
+	SDL_TimerID idSessionSave = 0;
+
+	if (opt.sessionPath)
+	{
+		SESSION_SAVE_EVENT = SDL_RegisterEvents(1);
+		idSessionSave = SDL_AddTimer(SESSION_SAVE_INTERVAL, SessionSaveCallback, 0);
+	}
+
+	UndoRing<GridSnapshot, UNDO_DEPTH> undo;
+	FrameGovernor governor(opt.frameBudget);
+
+	LatencyMeter latency;
+	AutoClicker clicker(opt.autoClicks);
+	SDL_TimerID idAutoClick = 0;
+
+	if (opt.autoClicks > 0)
+	{
+		AUTOCLICK_EVENT = SDL_RegisterEvents(1);
+		idAutoClick = SDL_AddTimer(AUTOCLICK_INTERVAL, AutoClickCallback, 0);
+	}
 
 	for (;;)
 	{
+		AllocTracker::EndFrame();
+
 		SDL_Event event;
 		bool haveEvent = (SDL_WaitEventTimeout(&event, 33) != 0);
+		const Uint64 eventTS = SDL_GetPerformanceCounter();
 
 		if (haveEvent && event.type == SDL_QUIT)
 			break;
 
-		if (anim.Active())
+		if (anim.Active() || particles.Active())
 		{
-			ClearWindow(rend);
-			grid.RedrawOld();
-			anim.Draw(rend);
+			AllocScope scope(ALLOC_DRAW);
+			const Uint64 drawTS = SDL_GetPerformanceCounter();
+			ClearWindow(rend, objects);
+
+			if (anim.Active())
+			{
+				grid.RedrawOld();
+				anim.Draw(rend);
 
-			if (!anim.Active())
+				if (!anim.Active())
+					grid.Redraw();
+			}
+			else
+			{
 				grid.Redraw();
+			}
 
-			SDL_RenderPresent(rend);
+			particles.Update();
+			objects.Flush();
+			particles.Draw(rend);
+
+			Present(rend, objects, capture);
+			latency.Presented();
+
+			if (Govern(governor, drawTS))
+				grid.SetQuality(governor.Level());
 		}
 
 		if (!haveEvent) continue;
 
+		AllocScope input(ALLOC_INPUT);
+
 		if (event.type == END_GAME_EVENT)
 		{
 			char buf[256];
 			sprintf(buf, "Time is up. You got: %i", grid.GetScore());
-			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_INFORMATION, WINDOW_CAPTION, buf, win);
-			grid.NewGame();
+			if (opt.autoClicks > 0)
+				SDL_Log("%s", buf);
+			else
+				SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_INFORMATION, WINDOW_CAPTION, buf, win);
+			if (puzzle)
+			{
+				anim.Cancel();
+				particles.Clear();
+				grid.Load(puzzles, size_t(opt.puzzleIndex));
+				ClearWindow(rend, objects);
+				grid.Redraw();
+				Present(rend, objects, capture);
+			}
+			else
+			{
+				grid.NewGame();
+			}
+
+			undo.Clear();
+			SendKeyframe(broadcast, grid);
+
+			gameStartTS = SDL_GetTicks();
+			SaveSession(session, grid, gameStartTS);
+
+			if (exportObs)
+				obsRing.Write(grid.Cells(), grid.GetScore());
+		}
+		else if (opt.sessionPath && event.type == SESSION_SAVE_EVENT)
+		{
+			SaveSession(session, grid, gameStartTS);
+		}
+		else if (opt.autoClicks > 0 && event.type == AUTOCLICK_EVENT)
+		{
+			if (clicker.Done())
+			{
+				if (!latency.Pending())
+				{
+					SDL_Event quit;
+					SDL_zero(quit);
+					quit.type = SDL_QUIT;
+					SDL_PushEvent(&quit);
+				}
+			}
+			else if (!anim.Active() && !latency.Pending())
+			{
+				clicker.Click(grid);
+			}
 		}
 		else if (!anim.Active() && event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT)
 		{
@@ -139,19 +716,60 @@ int main(int argc, char* argv[])
 
 			if (insideGrid)
 			{
-				ClearWindow(rend);
+				if (opt.latency)
+					latency.Input(eventTS);
+
+				ClearWindow(rend, objects);
 
 				if (grid.HasSelection())
 				{
-					grid.Swap(cell.x, cell.y);
+					GridSnapshot snap;
+					grid.Save(snap);
+
+					if (grid.Swap(cell.x, cell.y))
+					{
+						undo.Push(snap);
+						SaveSession(session, grid, gameStartTS);
+
+						if (exportObs)
+							obsRing.Write(grid.Cells(), grid.GetScore());
+					}
+
+					if (!broadcast.Flush())
+						SendKeyframe(broadcast, grid);
 				}
 				else
 				{
 					grid.Select(cell.x, cell.y);
 				}
 
+				latency.Handled();
+
 				if (!anim.Active())
-					SDL_RenderPresent(rend);
+				{
+					Present(rend, objects, capture);
+					latency.Presented();
+				}
+			}
+		}
+		else if (event.type == SDL_KEYDOWN &&
+				 (event.key.keysym.sym == SDLK_BACKSPACE || (event.key.keysym.sym == SDLK_z && (event.key.keysym.mod & KMOD_CTRL))))
+		{
+			GridSnapshot snap;
+
+			if (undo.Pop(snap))
+			{
+				anim.Cancel();
+				particles.Clear();
+				grid.Restore(snap);
+				ClearWindow(rend, objects);
+				grid.Redraw();
+				Present(rend, objects, capture);
+				SendKeyframe(broadcast, grid);
+				SaveSession(session, grid, gameStartTS);
+
+				if (exportObs)
+					obsRing.Write(grid.Cells(), grid.GetScore());
 			}
 		}
 		else if (event.type == SDL_WINDOWEVENT)
@@ -160,21 +778,48 @@ int main(int argc, char* argv[])
 				event.window.event == SDL_WINDOWEVENT_RESIZED)
 			{
 				if (anim.Active()) anim.Cancel();
-				ClearWindow(rend);
+				particles.Clear();
+				ClearWindow(rend, objects);
 				SDL_Rect gridPos;
 				GetGridRect(win, &gridPos);
 				grid.Move(gridPos);
-				SDL_RenderPresent(rend);
+				Present(rend, objects, capture);
 			}
 		}
 	}
 
 	SDL_RemoveTimer(idTimer);
+	if (idAutoClick) SDL_RemoveTimer(idAutoClick);
+	if (idSessionSave) SDL_RemoveTimer(idSessionSave);
+
+	capture.Stop();
+
+	if (broadcast.Active())
+	{
+		SDL_Log("broadcast: %llu moves, %llu bytes", (unsigned long long)broadcast.Moves(), (unsigned long long)broadcast.Bytes());
+		broadcast.Close();
+	}
+
+	AllocTracker::Report("session");
+
+	int ret = 0;
+
+	if (opt.latency)
+	{
+		const double p99 = latency.Report();
+
+		if (opt.latencyBudget > 0 && p99 > opt.latencyBudget)
+		{
+			SDL_Log("latency: p99 %.3f ms is over the %.3f ms budget", p99, opt.latencyBudget);
+			ret = 2;
+		}
+	}
+
 	SDL_FreeSurface(icon);
 	SDL_DestroyRenderer(rend);
 	SDL_DestroyWindow(win);
 
 	SDL_Quit();
 
-	return 0;
+	return ret;
 }
@@ -0,0 +1,237 @@
+// Puzzle pack tool: builds packs of starting boards and rates them on all cores
+
+#include "AllocTracker.h"
+#include "Board.h"
+#include "BatchGrid.h"
+#include "Observation.h"
+#include "PuzzlePack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static const uint32_t RATE_CHUNK = 256;
+static const int SWAP_PAIRS = (GRID_WIDTH - 1) * GRID_HEIGHT + GRID_WIDTH * (GRID_HEIGHT - 1);
+
+static void Decode(int action, int& x1, int& y1, int& x2, int& y2)
+{
+	const int cell = action / 2;
+	x1 = cell / GRID_HEIGHT;
+	y1 = cell % GRID_HEIGHT;
+	x2 = (action & 1) ? x1 : x1 + 1;
+	y2 = (action & 1) ? y1 + 1 : y1;
+}
+
+// Whether some sequence of depth legal moves exists from this board
+static bool Survives(const Board& board, int depth)
+{
+	if (depth <= 0) return true;
+
+	uint8_t legal[BatchGrid::ACTION_COUNT];
+	EncodeLegalMoves(board, legal);
+
+	for (int a = 0; a < BatchGrid::ACTION_COUNT; ++a)
+	{
+		if (!legal[a]) continue;
+
+		int x1, y1, x2, y2;
+		Decode(a, x1, y1, x2, y2);
+
+		Board next = board;
+		next.Swap(x1, y1, x2, y2);
+
+		if (Survives(next, depth - 1)) return true;
+	}
+
+	return false;
+}
+
+// Difficulty is the share of swaps that are not a viable first move, where
+// viable means legal and followed by depth - 1 further legal moves. Boards
+// with bad colors are left unrated.
+static bool Rate(const PuzzlePack& pack, size_t idx, int depth, PuzzleEntry& entry)
+{
+	TBoardCells cells;
+	if (!pack.Decode(idx, cells))
+	{
+		entry.moves = 0;
+		entry.difficulty = PUZZLE_UNRATED;
+		return false;
+	}
+
+	Board board;
+	board.Load(cells, entry.board + 1);
+
+	uint8_t legal[BatchGrid::ACTION_COUNT];
+	EncodeLegalMoves(board, legal);
+
+	int moves = 0, viable = 0;
+
+	for (int a = 0; a < BatchGrid::ACTION_COUNT; ++a)
+	{
+		if (!legal[a]) continue;
+
+		++moves;
+
+		int x1, y1, x2, y2;
+		Decode(a, x1, y1, x2, y2);
+
+		Board next = board;
+		next.Swap(x1, y1, x2, y2);
+
+		if (Survives(next, depth - 1)) ++viable;
+	}
+
+	entry.moves = uint16_t(moves);
+	entry.difficulty = uint16_t(1000 - 1000 * viable / SWAP_PAIRS);
+	return true;
+}
+
+static int Build(const char* path, uint32_t count, uint32_t seed)
+{
+	PuzzlePack pack;
+	if (!pack.Create(path, count))
+	{
+		fprintf(stderr, "Cannot create %s\n", path);
+		return 1;
+	}
+
+	Board board;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		board.NewGame(seed + i);
+		pack.Encode(i, board.Cells());
+	}
+
+	pack.Flush();
+
+	printf("%s: %u boards, %u bytes each\n", path, count, unsigned(PUZZLE_BOARD_SIZE));
+	return 0;
+}
+
+static int RateAll(const char* path, unsigned threads, int depth)
+{
+	PuzzlePack pack;
+	if (!pack.Open(path))
+	{
+		fprintf(stderr, "%s is not a puzzle pack\n", path);
+		return 1;
+	}
+
+	const uint32_t count = pack.Count();
+	std::atomic<uint32_t> next(0);
+	std::atomic<uint32_t> bad(0);
+	std::vector<std::thread> workers;
+
+	threads = std::max(1u, threads);
+
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			for (;;)
+			{
+				const uint32_t begin = next.fetch_add(RATE_CHUNK);
+				if (begin >= count) break;
+
+				const uint32_t end = std::min(count, begin + RATE_CHUNK);
+				for (uint32_t i = begin; i < end; ++i)
+					if (!Rate(pack, i, depth, pack.Entry(i)))
+						++bad;
+			}
+		}));
+	}
+
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+
+	// The whole rating pass counts as one frame
+	AllocTracker::EndFrame();
+	AllocTracker::Report("rating");
+
+	PuzzleEntry* index = &pack.Entry(0);
+	std::sort(index, index + count, [](const PuzzleEntry& a, const PuzzleEntry& b)
+	{
+		return a.difficulty < b.difficulty || (a.difficulty == b.difficulty && a.board < b.board);
+	});
+
+	pack.Flush();
+
+	// Unrated boards sort last
+	const uint32_t rated = count - bad;
+
+	printf("%s: rated %u boards on %u threads, depth %d, difficulty %u..%u\n", path, rated, threads, depth,
+		   rated ? unsigned(index[0].difficulty) : 0, rated ? unsigned(index[rated - 1].difficulty) : 0);
+
+	if (bad)
+	{
+		fprintf(stderr, "%s: %u boards with bad colors left unrated\n", path, unsigned(bad));
+		return 1;
+	}
+
+	return 0;
+}
+
+static int Show(const char* path, uint32_t idx)
+{
+	PuzzlePack pack;
+	if (!pack.Open(path) || idx >= pack.Count())
+	{
+		fprintf(stderr, "No board %u in %s\n", idx, path);
+		return 1;
+	}
+
+	const PuzzleEntry& e = pack.Entry(idx);
+	printf("board %u, legal moves %u, difficulty %u\n", e.board, unsigned(e.moves), unsigned(e.difficulty));
+
+	TCells cells;
+	if (!pack.Decode(idx, cells))
+	{
+		fprintf(stderr, "Board %u in %s is corrupt\n", idx, path);
+		return 1;
+	}
+
+	for (int y = 0; y < GRID_HEIGHT; ++y)
+	{
+		for (int x = 0; x < GRID_WIDTH; ++x)
+			printf("%d", cells[x][y]);
+		printf("\n");
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned threads = std::thread::hardware_concurrency();
+	int depth = 3;
+	uint32_t seed = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			threads = unsigned(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-depth") && i + 1 < argc)
+			depth = std::max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-seed") && i + 1 < argc)
+			seed = uint32_t(strtoul(argv[++i], 0, 10));
+		else if (!strcmp(argv[i], "-build") && i + 2 < argc)
+			return Build(argv[i + 1], uint32_t(strtoul(argv[i + 2], 0, 10)), seed);
+		else if (!strcmp(argv[i], "-rate") && i + 1 < argc)
+			return RateAll(argv[i + 1], threads, depth);
+		else if (!strcmp(argv[i], "-show") && i + 2 < argc)
+			return Show(argv[i + 1], uint32_t(strtoul(argv[i + 2], 0, 10)));
+		else
+			break;
+	}
+
+	fprintf(stderr,
+			"Usage: %s [-seed S] -build FILE COUNT\n"
+			"       %s [-threads T] [-depth D] -rate FILE\n"
+			"       %s -show FILE INDEX\n", argv[0], argv[0], argv[0]);
+	return 1;
+}
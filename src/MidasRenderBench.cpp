@@ -0,0 +1,304 @@
+// Rendering benchmark: drives Grid and Animations through scripted worst
+// cases for a fixed number of frames and reports per-frame costs
+
+#include "AllocTracker.h"
+#include "Animations.h"
+#include "Objects.h"
+#include "Grid.h"
+#include "Particles.h"
+#include "Observation.h"
+#include "Stats.h"
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static const char WINDOW_CAPTION[] = "Midas Miner render bench";
+static const SDL_Color CLEAR_COLOR = {   0,   0,   0, SDL_ALPHA_OPAQUE };
+static const int DEFAULT_FRAMES = 600;
+
+enum Scenario
+{
+	SCENE_REMOVALS,
+	SCENE_SLIDES,
+	SCENE_RESIZE,
+	SCENE_SWAPS,
+	SCENE_COUNT
+};
+
+static const char* SCENE_NAMES[SCENE_COUNT] = { "removals", "slides", "resize", "swaps" };
+
+static void ClearWindow(SDL_Renderer* rend, Objects& objects)
+{
+	objects.Clear(rend, CLEAR_COLOR);
+}
+
+// Every row and every column of the board disappears at once
+static void StartRemovals(Grid& grid, Animations& anim)
+{
+	const TCells& cells = grid.Cells();
+
+	for (int y = 0; y < GRID_HEIGHT; ++y)
+		anim.AddAnimation(new (anim) AnimateHorzRemoval(grid, 0, y, GRID_WIDTH, cells[0][y]), 0);
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+		anim.AddAnimation(new (anim) AnimateVertRemoval(grid, x, 0, GRID_HEIGHT, cells[x][0]), 0);
+}
+
+// Every column slides down one cell with everything above the bottom row
+static void StartSlides(Grid& grid, Animations& anim)
+{
+	const TCells& cells = grid.Cells();
+	const int len = GRID_HEIGHT - 1;
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		int column[GRID_HEIGHT];
+		memcpy(column, cells[x], sizeof(int) * len);
+		column[len] = 0;
+
+		anim.AddAnimation(new (anim) AnimateSlide(grid, x, len, len, column, len * AnimateSlide::STEP_DURATION), 0);
+	}
+}
+
+// Plays the first legal swap, or starts over when the board is stuck
+static bool StartSwap(Grid& grid)
+{
+	uint8_t legal[OBS_MASK_SIZE];
+	EncodeLegalMoves(grid.Cells(), legal);
+
+	for (int a = 0; a < int(OBS_MASK_SIZE); ++a)
+	{
+		if (!legal[a]) continue;
+
+		const int x = a / 2 / GRID_HEIGHT;
+		const int y = a / 2 % GRID_HEIGHT;
+
+		grid.Select(x, y);
+		grid.Swap((a & 1) ? x : x + 1, (a & 1) ? y + 1 : y);
+		return true;
+	}
+
+	grid.NewGame();
+	return false;
+}
+
+// Renderer textures, the atlas batch and compositor buffers size themselves
+// on first use; one untimed frame keeps that out of the measured run. Swap and
+// the cascade own preallocated storage, so every move is counted.
+static void WarmUp(SDL_Renderer* rend, Objects& objects, Grid& grid, Particles& particles)
+{
+	ClearWindow(rend, objects);
+	grid.Redraw();
+	particles.Update();
+	objects.Flush();
+	particles.Draw(rend);
+	SDL_RenderPresent(rend);
+}
+
+static void Resize(SDL_Window* win, Grid& grid, int frame)
+{
+	int w, h;
+	SDL_GetWindowSize(win, &w, &h);
+
+	const int side = std::min(w, h);
+	const int size = side / 2 + (frame * 7) % (side / 2 + 1);
+	const SDL_Rect pos = { (w - size) / 2, (h - size) / 2, size, size };
+
+	grid.Move(pos, false);
+}
+
+static int Run(SDL_Window* win, SDL_Renderer* rend, Objects& objects, Grid& grid, Animations& anim, Particles& particles, Scenario scene, int frames)
+{
+	Percentiles frameMs, drawCalls, allocs, moveAllocs;
+	int moves = 0;
+	const double freq = double(SDL_GetPerformanceFrequency());
+
+	// Sized up front, so recording a frame does not show up in its allocations
+	frameMs.Reserve(size_t(frames));
+	drawCalls.Reserve(size_t(frames));
+	allocs.Reserve(size_t(frames));
+	moveAllocs.Reserve(size_t(frames));
+
+	anim.Cancel();
+	particles.Clear();
+	WarmUp(rend, objects, grid, particles);
+	AllocTracker::Reset();
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		SDL_Event event;
+		while (SDL_PollEvent(&event))
+			if (event.type == SDL_QUIT) return 1;
+
+		AllocTracker::EndFrame();
+		DrawCounter::Take();
+		const uint64_t allocStart = AllocTracker::Count();
+		const Uint64 start = SDL_GetPerformanceCounter();
+
+		if (!anim.Active())
+		{
+			switch (scene)
+			{
+			case SCENE_REMOVALS: StartRemovals(grid, anim); break;
+			case SCENE_SLIDES:   StartSlides(grid, anim); break;
+			case SCENE_SWAPS:
+			{
+				const uint64_t moveStart = AllocTracker::Count();
+
+				if (StartSwap(grid))
+				{
+					moveAllocs.Add(double(AllocTracker::Count() - moveStart));
+					++moves;
+				}
+				break;
+			}
+			}
+		}
+
+		if (scene == SCENE_RESIZE)
+			Resize(win, grid, frame);
+
+		{
+			AllocScope scope(ALLOC_DRAW);
+			ClearWindow(rend, objects);
+
+			if (anim.Active())
+			{
+				grid.RedrawOld();
+				anim.Draw(rend);
+			}
+			else
+			{
+				grid.Redraw();
+			}
+
+			particles.Update();
+			objects.Flush();
+			particles.Draw(rend);
+		}
+
+		{
+			AllocScope scope(ALLOC_PRESENT);
+			SDL_RenderPresent(rend);
+		}
+
+		const uint64_t frameAllocs = AllocTracker::Count() - allocStart;
+
+		frameMs.Add(double(SDL_GetPerformanceCounter() - start) * 1000 / freq);
+		drawCalls.Add(DrawCounter::Take());
+		allocs.Add(double(frameAllocs));
+	}
+
+	SDL_Log("%-9s %d frames, frame ms p50 %.3f p95 %.3f p99 %.3f max %.3f, draw calls/frame mean %.1f max %.0f, allocations/frame mean %.2f max %.0f",
+			SCENE_NAMES[scene], frames,
+			frameMs.Get(50), frameMs.Get(95), frameMs.Get(99), frameMs.Get(100),
+			drawCalls.Mean(), drawCalls.Get(100), allocs.Mean(), allocs.Get(100));
+
+	AllocTracker::EndFrame();
+	AllocTracker::Report(SCENE_NAMES[scene]);
+
+	// Swap and the whole cascade must run without touching the heap
+	if (!moveAllocs.Empty())
+	{
+		SDL_Log("%-9s %d moves, allocations/move max %.0f", SCENE_NAMES[scene], moves, moveAllocs.Get(100));
+
+		if (moveAllocs.Get(100) > 0)
+			return 2;
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	int frames = DEFAULT_FRAMES;
+	int first = 0, last = SCENE_COUNT - 1;
+	int width = GRID_WIDTH * OBJ_WIDTH * 2, height = GRID_HEIGHT * OBJ_HEIGHT * 2;
+	Uint32 rendFlags = 0;
+	int quality = QUALITY_FULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-quality") && i + 1 < argc)
+			quality = SDL_clamp(atoi(argv[++i]), 0, QUALITY_COUNT - 1);
+		else if (!strcmp(argv[i], "-software"))
+			rendFlags = SDL_RENDERER_SOFTWARE;
+		else if (!strcmp(argv[i], "-size") && i + 2 < argc)
+		{
+			width = atoi(argv[++i]);
+			height = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-scenario") && i + 1 < argc)
+		{
+			++i;
+			int s = 0;
+			while (s < SCENE_COUNT && strcmp(argv[i], SCENE_NAMES[s])) ++s;
+
+			if (s < SCENE_COUNT)
+				first = last = s;
+			else if (strcmp(argv[i], "all"))
+				frames = -1;
+		}
+		else
+			frames = -1;
+	}
+
+	if (frames <= 0)
+	{
+		SDL_Log("Usage: %s [-frames N] [-size W H] [-software] [-quality 0-2] [-scenario removals|slides|resize|swaps|all]", argv[0]);
+		return -1;
+	}
+
+	if (SDL_Init(SDL_INIT_VIDEO) || !IMG_Init(IMG_INIT_PNG))
+	{
+		SDL_Log("%s", SDL_GetError());
+		return -1;
+	}
+
+	SDL_Window* win = SDL_CreateWindow(WINDOW_CAPTION, 0, 0, width, height, SDL_WINDOW_HIDDEN);
+	SDL_Renderer* rend = win ? SDL_CreateRenderer(win, -1, rendFlags) : 0;
+
+	if (!rend)
+	{
+		SDL_Log("%s", SDL_GetError());
+		return -1;
+	}
+
+	int ret = 0;
+
+	{
+		Objects objects;
+		if (!objects.Load(rend))
+		{
+			SDL_Log("%s", IMG_GetError());
+			return -1;
+		}
+
+		Animations anim;
+
+		const SDL_Rect pos = { 0, 0, std::min(width, height), std::min(width, height) };
+		Grid grid(rend, objects, anim, pos);
+		grid.SetQuality(Quality(quality));
+
+		Particles particles;
+		grid.SetParticles(&particles);
+
+		for (int s = first; s <= last && !ret; ++s)
+		{
+			grid.Move(pos, false);
+			ret = Run(win, rend, objects, grid, anim, particles, Scenario(s), frames);
+		}
+	}
+
+	SDL_DestroyRenderer(rend);
+	SDL_DestroyWindow(win);
+	IMG_Quit();
+	SDL_Quit();
+
+	return ret;
+}
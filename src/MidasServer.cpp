@@ -0,0 +1,762 @@
+// Server-authoritative game host: many Board sessions behind one epoll loop
+
+#include "AllocTracker.h"
+#include "Board.h"
+#include "Protocol.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static const char DEFAULT_SOCKET[] = "/tmp/midas_server.sock";
+static const unsigned DEFAULT_SESSIONS = 65536;
+static const unsigned WHEEL_TICK = 100; // ms
+static const unsigned WHEEL_SLOTS = 1024;
+static const int MAX_EVENTS = 256;
+static const size_t READ_CHUNK = 64 * 1024;
+
+static const int SESSION_BITS = 20;
+static const uint32_t SESSION_MASK = (1u << SESSION_BITS) - 1;
+
+static_assert(GAME_LEN / WHEEL_TICK < WHEEL_SLOTS, "a game must fit in one turn of the timer wheel");
+
+static uint64_t NowMs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000 + uint64_t(ts.tv_nsec) / 1000000;
+}
+
+static double ThreadCpuSeconds()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+}
+
+struct Session
+{
+	Board board;
+	uint64_t deadline;
+	int conn;
+	int prev;		// timer wheel slot list, or free list in next
+	int next;
+	uint16_t generation;
+	bool used;
+	bool expired;
+};
+
+// Hashed timer wheel over the session pool: O(1) add and remove, and one
+// slot visited per WHEEL_TICK
+class TimerWheel
+{
+public:
+	TimerWheel(std::vector<Session>& sessions, uint64_t now)
+		: m_sessions(sessions)
+		, m_heads(WHEEL_SLOTS, -1)
+		, m_tick(now / WHEEL_TICK)
+	{
+	}
+
+	void Add(int idx)
+	{
+		Session& s = m_sessions[idx];
+		const uint64_t tick = std::max(s.deadline / WHEEL_TICK, m_tick);
+		int& head = m_heads[tick % WHEEL_SLOTS];
+
+		s.prev = -1;
+		s.next = head;
+		if (head >= 0) m_sessions[head].prev = idx;
+		head = idx;
+	}
+
+	void Remove(int idx)
+	{
+		Session& s = m_sessions[idx];
+
+		if (s.prev >= 0)
+			m_sessions[s.prev].next = s.next;
+		else
+			m_heads[std::max(s.deadline / WHEEL_TICK, m_tick) % WHEEL_SLOTS] = s.next;
+
+		if (s.next >= 0)
+			m_sessions[s.next].prev = s.prev;
+
+		s.prev = s.next = -1;
+	}
+
+	template<class TExpire>
+	void Advance(uint64_t now, TExpire expire)
+	{
+		const uint64_t target = now / WHEEL_TICK;
+
+		for (; m_tick <= target; ++m_tick)
+		{
+			int idx = m_heads[m_tick % WHEEL_SLOTS];
+
+			while (idx >= 0)
+			{
+				const int next = m_sessions[idx].next;
+
+				if (m_sessions[idx].deadline / WHEEL_TICK <= m_tick)
+				{
+					Remove(idx);
+					expire(idx);
+				}
+
+				idx = next;
+			}
+		}
+	}
+
+private:
+	std::vector<Session>& m_sessions;
+	std::vector<int> m_heads;
+	uint64_t m_tick;
+};
+
+struct Connection
+{
+	bool open;
+	bool writing;
+	std::vector<uint8_t> in;
+	std::vector<uint8_t> out;
+	size_t outPos;
+	std::vector<int> sessions;
+};
+
+class Server
+{
+public:
+	Server(unsigned maxSessions);
+	~Server();
+
+	bool Listen(const char* path);
+	void Run(const std::atomic<bool>& stop);
+
+	uint64_t Moves() const { return m_moves; }
+	double CpuSeconds() const { return m_cpu; }
+
+private:
+	void Accept();
+	void Read(int fd);
+	void Flush(int fd);
+	void Close(int fd);
+
+	void Handle(int fd, const Request& req);
+	void Expire(int idx);
+	void FillReply(Reply& rep, int idx, uint8_t op, uint8_t status);
+	void Send(int fd, const Reply& rep);
+
+	int Allocate();
+	void Free(int idx);
+	int Lookup(uint32_t id);
+	uint32_t Id(int idx) const { return (uint32_t(m_sessions[idx].generation) << SESSION_BITS) | uint32_t(idx); }
+
+	int m_epoll;
+	int m_listen;
+	std::vector<Session> m_sessions;
+	int m_free;
+	TimerWheel m_wheel;
+	std::vector<Connection> m_conns;
+	uint64_t m_now;
+	uint32_t m_nextSeed;
+	uint64_t m_moves;
+	double m_cpu;
+	std::vector<uint8_t> m_buf;
+	std::vector<int> m_expiredConns;	// to flush once the wheel is done
+};
+
+Server::Server(unsigned maxSessions)
+	: m_epoll(epoll_create1(0))
+	, m_listen(-1)
+	, m_sessions(std::min(maxSessions, SESSION_MASK + 1))
+	, m_free(-1)
+	, m_wheel(m_sessions, NowMs())
+	, m_now(NowMs())
+	, m_nextSeed(uint32_t(m_now))
+	, m_moves(0)
+	, m_cpu(0)
+	, m_buf(READ_CHUNK)
+{
+	for (int i = int(m_sessions.size()) - 1; i >= 0; --i)
+	{
+		memset(&m_sessions[i], 0, sizeof(Session));
+		m_sessions[i].next = m_free;
+		m_free = i;
+	}
+}
+
+Server::~Server()
+{
+	for (size_t fd = 0; fd < m_conns.size(); ++fd)
+		if (m_conns[fd].open) close(int(fd));
+
+	if (m_listen >= 0) close(m_listen);
+	close(m_epoll);
+}
+
+bool Server::Listen(const char* path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) return false;
+	strcpy(addr.sun_path, path);
+
+	unlink(path);
+
+	m_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (m_listen < 0) return false;
+
+	if (bind(m_listen, (sockaddr*)&addr, sizeof(addr)) || listen(m_listen, SOMAXCONN))
+		return false;
+
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = m_listen;
+	return epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listen, &ev) == 0;
+}
+
+void Server::Run(const std::atomic<bool>& stop)
+{
+	epoll_event events[MAX_EVENTS];
+	const double cpuStart = ThreadCpuSeconds();
+
+	while (!stop.load(std::memory_order_relaxed))
+	{
+		const int n = epoll_wait(m_epoll, events, MAX_EVENTS, int(WHEEL_TICK));
+
+		m_now = NowMs();
+
+		for (int i = 0; i < n; ++i)
+		{
+			const int fd = events[i].data.fd;
+
+			if (fd == m_listen)
+			{
+				Accept();
+				continue;
+			}
+
+			if (events[i].events & EPOLLERR)
+			{
+				Close(fd);
+				continue;
+			}
+
+			// A hang-up may come with requests still queued; Read drains them
+			// and closes on end of stream
+			if (events[i].events & (EPOLLIN | EPOLLHUP))
+			{
+				AllocScope scope(ALLOC_INPUT);
+				Read(fd);
+			}
+
+			if ((events[i].events & EPOLLOUT) && size_t(fd) < m_conns.size() && m_conns[fd].open)
+				Flush(fd);
+		}
+
+		m_wheel.Advance(m_now, [this](int idx) { Expire(idx); });
+
+		// Flushing may close a connection and free its sessions, which must
+		// not happen while the wheel walks a slot
+		for (size_t i = 0; i < m_expiredConns.size(); ++i)
+			if (m_conns[m_expiredConns[i]].open)
+				Flush(m_expiredConns[i]);
+
+		m_expiredConns.clear();
+
+		// One pass of the loop is the server's frame
+		AllocTracker::EndFrame();
+	}
+
+	m_cpu = ThreadCpuSeconds() - cpuStart;
+}
+
+void Server::Accept()
+{
+	for (;;)
+	{
+		const int fd = accept4(m_listen, 0, 0, SOCK_NONBLOCK);
+		if (fd < 0) return;
+
+		if (size_t(fd) >= m_conns.size())
+			m_conns.resize(size_t(fd) + 1);
+
+		Connection& c = m_conns[fd];
+		c.open = true;
+		c.writing = false;
+		c.in.clear();
+		c.out.clear();
+		c.outPos = 0;
+		c.sessions.clear();
+
+		epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+	}
+}
+
+void Server::Read(int fd)
+{
+	Connection& c = m_conns[fd];
+	bool eof = false;
+
+	for (;;)
+	{
+		const ssize_t got = recv(fd, &m_buf[0], m_buf.size(), 0);
+
+		if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			Close(fd);
+			return;
+		}
+
+		if (got == 0) eof = true;
+		if (got <= 0) break;
+
+		c.in.insert(c.in.end(), m_buf.begin(), m_buf.begin() + got);
+	}
+
+	size_t pos = 0;
+	for (; pos + sizeof(Request) <= c.in.size(); pos += sizeof(Request))
+	{
+		Request req;
+		memcpy(&req, &c.in[pos], sizeof(req));
+		Handle(fd, req);
+
+		if (!c.open) return;
+	}
+
+	c.in.erase(c.in.begin(), c.in.begin() + ptrdiff_t(pos));
+
+	Flush(fd);
+
+	// The peer may only have shut down its sending side, so the replies
+	// above still went out
+	if (eof && c.open)
+		Close(fd);
+}
+
+void Server::Flush(int fd)
+{
+	Connection& c = m_conns[fd];
+
+	while (c.outPos < c.out.size())
+	{
+		const ssize_t sent = send(fd, &c.out[c.outPos], c.out.size() - c.outPos, MSG_NOSIGNAL);
+
+		if (sent < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			if (errno == EINTR) continue;
+			Close(fd);
+			return;
+		}
+
+		c.outPos += size_t(sent);
+	}
+
+	if (c.outPos == c.out.size())
+	{
+		c.out.clear();
+		c.outPos = 0;
+	}
+
+	const bool writing = !c.out.empty();
+	if (writing != c.writing)
+	{
+		epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = writing ? uint32_t(EPOLLIN | EPOLLOUT) : uint32_t(EPOLLIN);
+		ev.data.fd = fd;
+		epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev);
+		c.writing = writing;
+	}
+}
+
+void Server::Close(int fd)
+{
+	Connection& c = m_conns[fd];
+	if (!c.open) return;
+
+	for (size_t i = 0; i < c.sessions.size(); ++i)
+		Free(c.sessions[i]);
+
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, 0);
+	close(fd);
+
+	c.open = false;
+	c.sessions.clear();
+	std::vector<uint8_t>().swap(c.in);
+	std::vector<uint8_t>().swap(c.out);
+}
+
+void Server::Handle(int fd, const Request& req)
+{
+	Reply rep;
+
+	switch (req.op)
+	{
+	case OP_NEW:
+		{
+			const int idx = Allocate();
+
+			if (idx < 0)
+			{
+				memset(&rep, 0, sizeof(rep));
+				rep.op = OP_NEW;
+				rep.status = ST_FULL;
+				break;
+			}
+
+			Session& s = m_sessions[idx];
+			s.board.NewGame(req.seed ? req.seed : m_nextSeed++);
+			s.deadline = m_now + GAME_LEN;
+			s.conn = fd;
+			m_wheel.Add(idx);
+			m_conns[fd].sessions.push_back(idx);
+
+			FillReply(rep, idx, OP_NEW, ST_OK);
+		}
+		break;
+
+	case OP_SWAP:
+	case OP_STATE:
+	case OP_CLOSE:
+		{
+			const int idx = Lookup(req.session);
+
+			if (idx < 0 || m_sessions[idx].conn != fd)
+			{
+				memset(&rep, 0, sizeof(rep));
+				rep.op = req.op;
+				rep.status = ST_NO_SESSION;
+				rep.session = req.session;
+				break;
+			}
+
+			Session& s = m_sessions[idx];
+
+			if (req.op == OP_SWAP)
+			{
+				if (s.expired)
+				{
+					FillReply(rep, idx, OP_SWAP, ST_EXPIRED);
+					break;
+				}
+
+				AllocScope scope(ALLOC_SWAP);
+				const int cascades = s.board.Swap(req.x1, req.y1, req.x2, req.y2);
+				++m_moves;
+
+				FillReply(rep, idx, OP_SWAP, cascades ? ST_OK : ST_REJECTED);
+				rep.cascades = uint8_t(std::min(cascades, 255));
+			}
+			else if (req.op == OP_STATE)
+			{
+				FillReply(rep, idx, OP_STATE, s.expired ? ST_EXPIRED : ST_OK);
+			}
+			else
+			{
+				FillReply(rep, idx, OP_CLOSE, ST_OK);
+
+				std::vector<int>& owned = m_conns[fd].sessions;
+				for (size_t i = 0; i < owned.size(); ++i)
+				{
+					if (owned[i] == idx)
+					{
+						owned[i] = owned.back();
+						owned.pop_back();
+						break;
+					}
+				}
+
+				Free(idx);
+			}
+		}
+		break;
+
+	default:
+		memset(&rep, 0, sizeof(rep));
+		rep.op = req.op;
+		rep.status = ST_BAD_REQUEST;
+		break;
+	}
+
+	Send(fd, rep);
+}
+
+void Server::Expire(int idx)
+{
+	Session& s = m_sessions[idx];
+	s.expired = true;
+
+	Reply rep;
+	FillReply(rep, idx, OP_END, ST_EXPIRED);
+	Send(s.conn, rep);
+	m_expiredConns.push_back(s.conn);
+}
+
+void Server::FillReply(Reply& rep, int idx, uint8_t op, uint8_t status)
+{
+	const Session& s = m_sessions[idx];
+
+	rep.op = op;
+	rep.status = status;
+	rep.cascades = 0;
+	rep.reserved = 0;
+	rep.session = Id(idx);
+	rep.score = s.board.Score();
+	rep.timeLeft = (s.expired || s.deadline <= m_now) ? 0 : uint32_t(s.deadline - m_now);
+	memcpy(rep.cells, s.board.Cells(), sizeof(rep.cells));
+}
+
+void Server::Send(int fd, const Reply& rep)
+{
+	std::vector<uint8_t>& out = m_conns[fd].out;
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(&rep);
+	out.insert(out.end(), p, p + sizeof(rep));
+}
+
+int Server::Allocate()
+{
+	const int idx = m_free;
+	if (idx < 0) return -1;
+
+	Session& s = m_sessions[idx];
+	m_free = s.next;
+
+	s.used = true;
+	s.expired = false;
+	s.prev = s.next = -1;
+	return idx;
+}
+
+void Server::Free(int idx)
+{
+	Session& s = m_sessions[idx];
+
+	if (!s.expired)
+		m_wheel.Remove(idx);
+
+	s.used = false;
+	s.conn = -1;
+	++s.generation;
+	s.next = m_free;
+	m_free = idx;
+}
+
+int Server::Lookup(uint32_t id)
+{
+	const uint32_t idx = id & SESSION_MASK;
+
+	if (idx >= m_sessions.size()) return -1;
+
+	const Session& s = m_sessions[idx];
+	if (!s.used || s.generation != uint16_t(id >> SESSION_BITS)) return -1;
+
+	return int(idx);
+}
+
+// Loopback client for -bench: opens sessions and keeps one swap in flight
+// per session, checking every reply
+static bool RunClient(const char* path, unsigned sessions, unsigned moves, uint32_t seed, uint64_t& done)
+{
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return false;
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)))
+	{
+		close(fd);
+		return false;
+	}
+
+	std::vector<Request> reqs(sessions);
+	std::vector<Reply> reps(sessions);
+	std::vector<uint32_t> ids(sessions);
+	uint32_t rng = SeedRandom(seed);
+	bool ok = true;
+
+	const auto exchange = [&](size_t count) -> bool
+	{
+		if (send(fd, &reqs[0], count * sizeof(Request), MSG_NOSIGNAL) != ssize_t(count * sizeof(Request)))
+			return false;
+
+		size_t got = 0;
+		uint8_t* dst = reinterpret_cast<uint8_t*>(&reps[0]);
+		while (got < count * sizeof(Reply))
+		{
+			const ssize_t n = recv(fd, dst + got, count * sizeof(Reply) - got, 0);
+			if (n <= 0) return false;
+			got += size_t(n);
+		}
+
+		return true;
+	};
+
+	memset(&reqs[0], 0, reqs.size() * sizeof(Request));
+	for (unsigned i = 0; i < sessions; ++i)
+	{
+		reqs[i].op = OP_NEW;
+		reqs[i].seed = seed * 7919 + i + 1;
+	}
+
+	if (!exchange(sessions))
+		ok = false;
+
+	for (unsigned i = 0; ok && i < sessions; ++i)
+	{
+		if (reps[i].op != OP_NEW || reps[i].status != ST_OK) ok = false;
+		ids[i] = reps[i].session;
+	}
+
+	for (unsigned m = 0; ok && m < moves; m += sessions)
+	{
+		// The last round only plays what is left of moves
+		const unsigned round = std::min(sessions, moves - m);
+
+		for (unsigned i = 0; i < round; ++i)
+		{
+			Request& r = reqs[i];
+			const bool down = NextRandom(rng) & 1;
+
+			r.op = OP_SWAP;
+			r.session = ids[i];
+			r.x1 = uint8_t(NextRandom(rng) % (GRID_WIDTH - (down ? 0 : 1)));
+			r.y1 = uint8_t(NextRandom(rng) % (GRID_HEIGHT - (down ? 1 : 0)));
+			r.x2 = uint8_t(r.x1 + (down ? 0 : 1));
+			r.y2 = uint8_t(r.y1 + (down ? 1 : 0));
+		}
+
+		if (!exchange(round))
+		{
+			ok = false;
+			break;
+		}
+
+		for (unsigned i = 0; i < round; ++i)
+		{
+			const Reply& r = reps[i];
+			if (r.op != OP_SWAP || r.session != ids[i] || (r.status != ST_OK && r.status != ST_REJECTED))
+				ok = false;
+		}
+
+		done += round;
+	}
+
+	close(fd);
+	return ok;
+}
+
+static int Bench(const char* path, unsigned clients, unsigned sessions, unsigned moves)
+{
+	Server server(clients * sessions);
+	if (!server.Listen(path))
+	{
+		fprintf(stderr, "Cannot listen on %s\n", path);
+		return 1;
+	}
+
+	std::atomic<bool> stop(false);
+	std::thread serverThread([&]() { server.Run(stop); });
+
+	std::vector<std::thread> threads;
+	std::vector<uint64_t> done(clients, 0);
+	std::vector<char> ok(clients, 0);
+	const uint64_t start = NowMs();
+
+	for (unsigned i = 0; i < clients; ++i)
+		threads.push_back(std::thread([&, i]() { ok[i] = RunClient(path, sessions, moves, i + 1, done[i]); }));
+
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	const double elapsed = double(NowMs() - start) / 1000;
+
+	stop = true;
+	serverThread.join();
+	unlink(path);
+
+	AllocTracker::Report("server");
+
+	uint64_t total = 0;
+	bool allOk = true;
+	for (unsigned i = 0; i < clients; ++i)
+	{
+		total += done[i];
+		allOk = allOk && ok[i];
+	}
+
+	printf("%u clients x %u sessions: %llu moves in %.2f s, %.0f moves/s, %.0f moves per server CPU second\n",
+		   clients, sessions, (unsigned long long)server.Moves(), elapsed,
+		   double(server.Moves()) / elapsed, double(server.Moves()) / server.CpuSeconds());
+
+	if (!allOk || total != server.Moves())
+	{
+		fprintf(stderr, "Loopback check failed\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* path = DEFAULT_SOCKET;
+	unsigned maxSessions = DEFAULT_SESSIONS;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-socket") && i + 1 < argc)
+			path = argv[++i];
+		else if (!strcmp(argv[i], "-sessions") && i + 1 < argc)
+			maxSessions = unsigned(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-bench") && i + 3 < argc)
+		{
+			const unsigned clients = unsigned(atoi(argv[i + 1]));
+			const unsigned sessions = unsigned(atoi(argv[i + 2]));
+			const unsigned moves = unsigned(atoi(argv[i + 3]));
+			return Bench(path, clients, sessions, moves);
+		}
+		else
+		{
+			fprintf(stderr, "Usage: %s [-socket PATH] [-sessions N] [-bench CLIENTS SESSIONS MOVES]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	Server server(maxSessions);
+	if (!server.Listen(path))
+	{
+		fprintf(stderr, "Cannot listen on %s\n", path);
+		return 1;
+	}
+
+	std::atomic<bool> stop(false);
+	server.Run(stop);
+	return 0;
+}
@@ -0,0 +1,398 @@
+// Headless batch simulation: plays seeded games with a fixed policy, writes
+// one record per game and merges record files into histograms
+
+#include "AllocTracker.h"
+#include "Board.h"
+#include "BatchGrid.h"
+#include "Observation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const uint32_t SIM_MAGIC = 0x4d49534d; // "MSIM"
+static const uint32_t SIM_VERSION = 1;
+static const int CASCADE_BUCKETS = 8; // cascade lengths 1..7 and 8+
+static const size_t FLUSH_RECORDS = 4096;
+
+enum Policy
+{
+	POLICY_RANDOM,
+	POLICY_FIRST,
+	POLICY_GREEDY
+};
+
+static const char* POLICY_NAMES[] = { "random", "first", "greedy" };
+static const size_t POLICY_COUNT = sizeof(POLICY_NAMES) / sizeof(POLICY_NAMES[0]);
+
+#pragma pack(push, 1)
+
+// The rules a file was produced with, so shards of different builds are not mixed
+struct SimHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint8_t gridWidth;
+	uint8_t gridHeight;
+	uint8_t minRange;
+	uint8_t objCount;
+	uint16_t cellScore;
+	uint8_t policy;
+	uint8_t reserved;
+	uint32_t maxMoves;
+};
+
+struct SimRecord
+{
+	uint32_t seed;
+	int32_t score;
+	uint16_t moves;
+	uint8_t stuck;		// ran out of legal moves before maxMoves
+	uint8_t maxCascade;
+	uint16_t cascades[CASCADE_BUCKETS];
+};
+
+#pragma pack(pop)
+
+static SimHeader MakeHeader(Policy policy, unsigned maxMoves)
+{
+	SimHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = SIM_MAGIC;
+	h.version = SIM_VERSION;
+	h.recordSize = sizeof(SimRecord);
+	h.gridWidth = GRID_WIDTH;
+	h.gridHeight = GRID_HEIGHT;
+	h.minRange = MIN_RANGE;
+	h.objCount = OBJ_COUNT;
+	h.cellScore = CELL_SCORE;
+	h.policy = uint8_t(policy);
+	h.maxMoves = maxMoves;
+	return h;
+}
+
+static void Decode(int action, int& x1, int& y1, int& x2, int& y2)
+{
+	const int cell = action / 2;
+	x1 = cell / GRID_HEIGHT;
+	y1 = cell % GRID_HEIGHT;
+	x2 = (action & 1) ? x1 : x1 + 1;
+	y2 = (action & 1) ? y1 + 1 : y1;
+}
+
+static int ChooseMove(const Board& board, const uint8_t* legal, Policy policy, uint32_t& rng)
+{
+	int candidates[BatchGrid::ACTION_COUNT];
+	int count = 0;
+
+	for (int a = 0; a < BatchGrid::ACTION_COUNT; ++a)
+		if (legal[a]) candidates[count++] = a;
+
+	if (!count) return -1;
+
+	switch (policy)
+	{
+	case POLICY_FIRST:
+		return candidates[0];
+
+	case POLICY_GREEDY:
+		{
+			int best = candidates[0];
+			int bestScore = -1;
+
+			for (int i = 0; i < count; ++i)
+			{
+				int x1, y1, x2, y2;
+				Decode(candidates[i], x1, y1, x2, y2);
+
+				Board trial = board;
+				trial.Swap(x1, y1, x2, y2);
+
+				if (trial.Score() > bestScore)
+				{
+					bestScore = trial.Score();
+					best = candidates[i];
+				}
+			}
+
+			return best;
+		}
+
+	default:
+		return candidates[NextRandom(rng) % uint32_t(count)];
+	}
+}
+
+static void PlayGame(uint32_t seed, Policy policy, unsigned maxMoves, SimRecord& rec)
+{
+	memset(&rec, 0, sizeof(rec));
+	rec.seed = seed;
+
+	Board board;
+	board.NewGame(seed);
+
+	uint32_t rng = SeedRandom(seed ^ 0x9e3779b9u);
+	uint8_t legal[BatchGrid::ACTION_COUNT];
+
+	for (; rec.moves < maxMoves; ++rec.moves)
+	{
+		EncodeLegalMoves(board, legal);
+
+		const int action = ChooseMove(board, legal, policy, rng);
+		if (action < 0)
+		{
+			rec.stuck = 1;
+			break;
+		}
+
+		int x1, y1, x2, y2;
+		Decode(action, x1, y1, x2, y2);
+
+		int steps;
+		{
+			AllocScope scope(ALLOC_SWAP);
+			steps = board.Swap(x1, y1, x2, y2);
+		}
+
+		if (steps <= 0) break; // cannot happen for a legal move
+
+		++rec.cascades[std::min(steps, CASCADE_BUCKETS) - 1];
+		rec.maxCascade = uint8_t(std::max<int>(rec.maxCascade, std::min(steps, 255)));
+	}
+
+	rec.score = board.Score();
+}
+
+static int Simulate(const char* out, uint32_t firstSeed, uint32_t count, unsigned shard, unsigned shards,
+					unsigned threads, Policy policy, unsigned maxMoves)
+{
+	if (!shards || shard >= shards)
+	{
+		fprintf(stderr, "Bad shard %u/%u\n", shard, shards);
+		return 1;
+	}
+
+	const uint32_t begin = firstSeed + uint32_t(uint64_t(count) * shard / shards);
+	const uint32_t end   = firstSeed + uint32_t(uint64_t(count) * (shard + 1) / shards);
+
+	FILE* f = fopen(out, "wb");
+	if (!f)
+	{
+		fprintf(stderr, "Cannot create %s\n", out);
+		return 1;
+	}
+
+	const SimHeader header = MakeHeader(policy, maxMoves);
+	fwrite(&header, sizeof(header), 1, f);
+
+	std::mutex lock;
+	std::vector<std::thread> workers;
+	bool ok = true;
+
+	threads = std::max(1u, threads);
+
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		workers.push_back(std::thread([&, t]()
+		{
+			std::vector<SimRecord> batch;
+			batch.reserve(FLUSH_RECORDS);
+
+			for (uint32_t seed = begin + t; seed < end; seed += threads)
+			{
+				batch.resize(batch.size() + 1);
+				PlayGame(seed, policy, maxMoves, batch.back());
+
+				if (batch.size() == FLUSH_RECORDS || seed + threads >= end)
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					if (fwrite(&batch[0], sizeof(SimRecord), batch.size(), f) != batch.size())
+						ok = false;
+					batch.clear();
+				}
+			}
+		}));
+	}
+
+	for (size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+
+	// The whole run counts as one frame
+	AllocTracker::EndFrame();
+	AllocTracker::Report("simulation");
+
+	if (fclose(f) || !ok)
+	{
+		fprintf(stderr, "Cannot write %s\n", out);
+		return 1;
+	}
+
+	printf("%s: seeds %u..%u, %u games, policy %s\n", out, begin, end, end - begin, POLICY_NAMES[policy]);
+	return 0;
+}
+
+static int Merge(int count, char* files[], int bucket)
+{
+	std::vector<uint64_t> scores;
+	uint64_t cascades[CASCADE_BUCKETS] = { 0 };
+	uint64_t games = 0, moves = 0, stuck = 0, scoreSum = 0;
+	SimHeader first;
+	bool haveHeader = false;
+
+	bucket = std::max(1, bucket);
+
+	for (int i = 0; i < count; ++i)
+	{
+		FILE* f = fopen(files[i], "rb");
+		SimHeader h;
+
+		if (!f || fread(&h, sizeof(h), 1, f) != 1 || h.magic != SIM_MAGIC ||
+			h.version != SIM_VERSION || h.recordSize != sizeof(SimRecord))
+		{
+			fprintf(stderr, "%s is not a simulation file\n", files[i]);
+			if (f) fclose(f);
+			return 1;
+		}
+
+		if (!haveHeader)
+		{
+			first = h;
+			haveHeader = true;
+		}
+		else if (memcmp(&first, &h, sizeof(h)))
+		{
+			fprintf(stderr, "%s was produced with different rules or policy\n", files[i]);
+			fclose(f);
+			return 1;
+		}
+
+		SimRecord recs[1024];
+		size_t got;
+
+		while ((got = fread(recs, sizeof(SimRecord), sizeof(recs) / sizeof(recs[0]), f)) > 0)
+		{
+			for (size_t r = 0; r < got; ++r)
+			{
+				const SimRecord& rec = recs[r];
+				const size_t b = size_t(std::max(0, rec.score) / bucket);
+
+				if (b >= scores.size()) scores.resize(b + 1);
+				++scores[b];
+
+				for (int c = 0; c < CASCADE_BUCKETS; ++c)
+					cascades[c] += rec.cascades[c];
+
+				++games;
+				moves += rec.moves;
+				stuck += rec.stuck;
+				scoreSum += uint64_t(std::max(0, rec.score));
+			}
+		}
+
+		fclose(f);
+	}
+
+	if (!games)
+	{
+		fprintf(stderr, "No games\n");
+		return 1;
+	}
+
+	printf("# games %llu, moves %llu, stuck %llu, mean score %.1f, policy %s\n",
+		   (unsigned long long)games, (unsigned long long)moves, (unsigned long long)stuck,
+		   double(scoreSum) / double(games), POLICY_NAMES[first.policy % POLICY_COUNT]);
+
+	printf("# score_from,score_to,games\n");
+	for (size_t b = 0; b < scores.size(); ++b)
+		if (scores[b])
+			printf("%zu,%zu,%llu\n", b * size_t(bucket), (b + 1) * size_t(bucket) - 1, (unsigned long long)scores[b]);
+
+	printf("# cascade_length,moves\n");
+	for (int c = 0; c < CASCADE_BUCKETS; ++c)
+		printf("%d%s,%llu\n", c + 1, c + 1 == CASCADE_BUCKETS ? "+" : "", (unsigned long long)cascades[c]);
+
+	return 0;
+}
+
+static void Usage(const char* name)
+{
+	fprintf(stderr,
+			"Usage: %s -out FILE [-seeds FIRST COUNT] [-shard I N] [-threads T] [-policy random|first|greedy] [-moves M]\n"
+			"       %s -merge [-bucket B] FILE...\n", name, name);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* out = 0;
+	uint32_t firstSeed = 1, count = 1000000;
+	unsigned shard = 0, shards = 1;
+	unsigned threads = std::thread::hardware_concurrency();
+	unsigned maxMoves = 100;
+	int bucket = 100;
+	Policy policy = POLICY_RANDOM;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-merge"))
+		{
+			for (++i; i + 1 < argc && !strcmp(argv[i], "-bucket"); i += 2)
+				bucket = atoi(argv[i + 1]);
+
+			if (i >= argc)
+			{
+				Usage(argv[0]);
+				return 1;
+			}
+
+			return Merge(argc - i, argv + i, bucket);
+		}
+		else if (!strcmp(argv[i], "-out") && i + 1 < argc)
+			out = argv[++i];
+		else if (!strcmp(argv[i], "-seeds") && i + 2 < argc)
+		{
+			firstSeed = uint32_t(strtoul(argv[++i], 0, 10));
+			count = uint32_t(strtoul(argv[++i], 0, 10));
+		}
+		else if (!strcmp(argv[i], "-shard") && i + 2 < argc)
+		{
+			shard = unsigned(atoi(argv[++i]));
+			shards = unsigned(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			threads = unsigned(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-moves") && i + 1 < argc)
+			maxMoves = unsigned(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-policy") && i + 1 < argc)
+		{
+			++i;
+			size_t p = 0;
+			while (p < POLICY_COUNT && strcmp(argv[i], POLICY_NAMES[p])) ++p;
+
+			if (p == POLICY_COUNT)
+			{
+				Usage(argv[0]);
+				return 1;
+			}
+
+			policy = Policy(p);
+		}
+		else
+		{
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!out)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	return Simulate(out, firstSeed, count, shard, shards, threads, policy, std::min(maxMoves, 65535u));
+}
@@ -1,14 +1,44 @@
 #include "Objects.h"
+#include "AllocTracker.h"
+#include "Board.h"
+#include "Compositor.h"
+#include "Stats.h"
 
 #include <SDL_image.h>
+#include <algorithm>
 #include <cassert>
 
 static const char* OBJ_NAMES[OBJ_COUNT] = { ASSET_NAME("Blue.png"), ASSET_NAME("Green.png"), ASSET_NAME("Purple.png"), ASSET_NAME("Red.png"), ASSET_NAME("Yellow.png") };
 static const SDL_Point OBJ_SIZES[OBJ_COUNT] = { { 35, 36 }, { 35, 35 }, { 35, 35 }, { 34, 36 }, { 38, 37 } };
 
+static const SDL_Color MARK_COLOR = { 255, 255, 255, SDL_ALPHA_OPAQUE };
+
+static const int WHITE_PATCH = 4;
+static const size_t BATCH_QUADS = 4096;
+
+// For AllocTracker, which has no SDL
+static uint64_t TextureBytes(SDL_Texture* text)
+{
+	Uint32 format = 0;
+	int w = 0, h = 0;
+
+	if (!text || SDL_QueryTexture(text, &format, NULL, &w, &h)) return 0;
+
+	return uint64_t(w) * uint64_t(h) * SDL_BYTESPERPIXEL(format);
+}
+
 bool Image::Load(SDL_Renderer* rend, const char* name)
 {
 	m_text = IMG_LoadTexture(rend, name);
+	AllocTracker::AddTexture(TextureBytes(m_text));
+
+	return m_text != 0;
+}
+
+bool Image::Load(SDL_Renderer* rend, SDL_Surface* surf)
+{
+	m_text = SDL_CreateTextureFromSurface(rend, surf);
+	AllocTracker::AddTexture(TextureBytes(m_text));
 
 	return m_text != 0;
 }
@@ -18,19 +48,79 @@ Image::~Image()
 	SDL_DestroyTexture(m_text);
 }
 
+Objects::~Objects()
+{
+	delete m_compositor;
+}
+
 bool Objects::Load(SDL_Renderer* rend)
 {
+	SDL_Surface* surfs[OBJ_COUNT] = { 0 };
+	bool ok = true;
+
+	for (int i = 0; i < OBJ_COUNT && ok; ++i)
+	{
+		surfs[i] = IMG_Load(OBJ_NAMES[i]);
+		ok = surfs[i] && m_images[i].Load(rend, surfs[i]);
+	}
+
+	// Without an atlas batches fall back to immediate draws
+	if (ok && !BuildAtlas(rend, surfs))
+		SDL_Log("Sprite atlas unavailable: %s", SDL_GetError());
+
+	if (ok && Compositor::Wanted(rend))
+	{
+		m_compositor = new Compositor;
+
+		if (!m_compositor->Init(rend, surfs, OBJ_COUNT))
+		{
+			SDL_Log("Software compositor unavailable: %s", SDL_GetError());
+			delete m_compositor;
+			m_compositor = 0;
+		}
+	}
+
+	for (int i = 0; i < OBJ_COUNT; ++i)
+		SDL_FreeSurface(surfs[i]);
+
+	m_vertices.reserve(BATCH_QUADS * 4);
+	m_indices.reserve(BATCH_QUADS * 6);
+
+	return ok;
+}
+
+bool Objects::BuildAtlas(SDL_Renderer* rend, SDL_Surface* surfs[OBJ_COUNT])
+{
+	m_atlasWidth = OBJ_WIDTH * (OBJ_COUNT + 1);
+	m_atlasHeight = OBJ_HEIGHT;
+
+	SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, m_atlasWidth, m_atlasHeight, 32, SDL_PIXELFORMAT_RGBA32);
+	if (!atlas) return false;
+
+	SDL_FillRect(atlas, NULL, SDL_MapRGBA(atlas->format, 0, 0, 0, 0));
+
+	// Each sprite keeps a transparent gutter to its slot so filtering does not bleed
 	for (int i = 0; i < OBJ_COUNT; ++i)
 	{
-		if (!m_images[i].Load(rend, OBJ_NAMES[i]))
-			return false;
+		SDL_Rect rc = { i * OBJ_WIDTH, 0, surfs[i]->w, surfs[i]->h };
+		SDL_SetSurfaceBlendMode(surfs[i], SDL_BLENDMODE_NONE);
+		SDL_BlitSurface(surfs[i], NULL, atlas, &rc);
+		m_atlasRects[i] = rc;
 	}
 
-	return true;
+	const SDL_Rect white = { OBJ_COUNT * OBJ_WIDTH + (OBJ_WIDTH - WHITE_PATCH) / 2, (OBJ_HEIGHT - WHITE_PATCH) / 2, WHITE_PATCH, WHITE_PATCH };
+	SDL_FillRect(atlas, &white, SDL_MapRGBA(atlas->format, 255, 255, 255, 255));
+	m_atlasRects[OBJ_COUNT] = white;
+
+	const bool ok = m_atlas.Load(rend, atlas);
+	SDL_FreeSurface(atlas);
+
+	return ok;
 }
 
-void Objects::DrawTexture(SDL_Renderer* rend, int x, int y, int w, int h, int idx, double scale)
+void Objects::DrawTexture(SDL_Renderer* rend, int x, int y, int w, int h, int cell, double scale)
 {
+	const int idx = CellColor(cell);
 	double scaleX = double(w) / OBJ_WIDTH;
 	double scaleY = double(h) / OBJ_HEIGHT;
 	const int obj_width  = int(Size(idx).x * scaleX * scale + 0.5);
@@ -38,7 +128,152 @@ void Objects::DrawTexture(SDL_Renderer* rend, int x, int y, int w, int h, int id
 	const int x_adj = int((OBJ_WIDTH  * scaleX - obj_width)  / 2 + 0.5);
 	const int y_adj = int((OBJ_HEIGHT * scaleY - obj_height) / 2 + 0.5);
 	const SDL_Rect dest = { x + x_adj, y + y_adj, obj_width, obj_height };
-	SDL_RenderCopy(rend, Texture(idx), NULL,  &dest);
+
+	if (m_compositor)
+	{
+		m_compositor->DrawSprite(idx, dest);
+	}
+	else if (m_batch)
+	{
+		static const SDL_Color WHITE = { 255, 255, 255, SDL_ALPHA_OPAQUE };
+		AddQuad(dest, m_atlasRects[idx], WHITE);
+	}
+	else
+	{
+		SDL_RenderCopy(rend, Texture(idx), NULL,  &dest);
+		DrawCounter::Add();
+	}
+
+	if (cell & CELL_SPECIAL)
+		DrawMark(rend, dest, cell);
+}
+
+// Special tiles get a bar along their clearing line or a dot for a bomb
+void Objects::DrawMark(SDL_Renderer* rend, const SDL_Rect& rc, int cell)
+{
+	const int bar = std::max(2, rc.h / 8);
+	const int dot = rc.w / 3;
+
+	if (cell & CELL_LINE_H)
+	{
+		const SDL_Rect mark = { rc.x, rc.y + (rc.h - bar) / 2, rc.w, bar };
+		FillRect(rend, mark, MARK_COLOR);
+	}
+	else if (cell & CELL_LINE_V)
+	{
+		const SDL_Rect mark = { rc.x + (rc.w - bar) / 2, rc.y, bar, rc.h };
+		FillRect(rend, mark, MARK_COLOR);
+	}
+	else if (cell & CELL_BOMB)
+	{
+		const SDL_Rect mark = { rc.x + (rc.w - dot) / 2, rc.y + (rc.h - dot) / 2, dot, dot };
+		FillRect(rend, mark, MARK_COLOR);
+	}
+}
+
+void Objects::FillRect(SDL_Renderer* rend, const SDL_Rect& rc, const SDL_Color& clr)
+{
+	if (m_compositor)
+	{
+		m_compositor->FillRect(rc, clr);
+		return;
+	}
+
+	if (m_batch)
+	{
+		// Sample the middle of the white patch only, so the quad is flat clr
+		const SDL_Rect& white = m_atlasRects[OBJ_COUNT];
+		const SDL_Rect src = { white.x + white.w / 2, white.y + white.h / 2, 0, 0 };
+		AddQuad(rc, src, clr);
+		return;
+	}
+
+	SDL_SetRenderDrawColor(rend, clr.r, clr.g, clr.b, clr.a);
+	SDL_RenderFillRect(rend, &rc);
+	DrawCounter::Add();
+}
+
+void Objects::DrawRect(SDL_Renderer* rend, const SDL_Rect& rc, const SDL_Color& clr)
+{
+	if (m_batch || m_compositor)
+	{
+		const SDL_Rect top    = { rc.x, rc.y, rc.w, 1 };
+		const SDL_Rect bottom = { rc.x, rc.y + rc.h - 1, rc.w, 1 };
+		const SDL_Rect left   = { rc.x, rc.y, 1, rc.h };
+		const SDL_Rect right  = { rc.x + rc.w - 1, rc.y, 1, rc.h };
+		FillRect(rend, top, clr);
+		FillRect(rend, bottom, clr);
+		FillRect(rend, left, clr);
+		FillRect(rend, right, clr);
+		return;
+	}
+
+	SDL_SetRenderDrawColor(rend, clr.r, clr.g, clr.b, clr.a);
+	SDL_RenderDrawRect(rend, &rc);
+	DrawCounter::Add();
+}
+
+void Objects::Clear(SDL_Renderer* rend, const SDL_Color& clr)
+{
+	if (m_compositor)
+	{
+		m_compositor->Clear(clr);
+		return;
+	}
+
+	SDL_SetRenderDrawColor(rend, clr.r, clr.g, clr.b, clr.a);
+	SDL_RenderClear(rend);
+	DrawCounter::Add();
+}
+
+void Objects::BeginBatch()
+{
+	// The compositor already draws everything in one upload
+	m_batch = m_atlas.Valid() && !m_compositor;
+	m_vertices.clear();
+	m_indices.clear();
+}
+
+void Objects::EndBatch(SDL_Renderer* rend)
+{
+	if (m_batch && !m_vertices.empty())
+	{
+		SDL_RenderGeometry(rend, m_atlas.Texture(), &m_vertices[0], int(m_vertices.size()), &m_indices[0], int(m_indices.size()));
+		DrawCounter::Add();
+	}
+
+	m_batch = false;
+}
+
+void Objects::Flush()
+{
+	if (m_compositor)
+		m_compositor->Flush();
+}
+
+void Objects::AddQuad(const SDL_Rect& dest, const SDL_Rect& src, const SDL_Color& clr)
+{
+	const int base = int(m_vertices.size());
+	const float u0 = float(src.x) / float(m_atlasWidth);
+	const float v0 = float(src.y) / float(m_atlasHeight);
+	const float u1 = float(src.x + src.w) / float(m_atlasWidth);
+	const float v1 = float(src.y + src.h) / float(m_atlasHeight);
+	const float x0 = float(dest.x);
+	const float y0 = float(dest.y);
+	const float x1 = float(dest.x + dest.w);
+	const float y1 = float(dest.y + dest.h);
+
+	const SDL_Vertex quad[4] =
+	{
+		{ { x0, y0 }, clr, { u0, v0 } },
+		{ { x1, y0 }, clr, { u1, v0 } },
+		{ { x1, y1 }, clr, { u1, v1 } },
+		{ { x0, y1 }, clr, { u0, v1 } }
+	};
+	m_vertices.insert(m_vertices.end(), quad, quad + 4);
+
+	const int idx[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+	m_indices.insert(m_indices.end(), idx, idx + 6);
 }
 
 SDL_Texture* Objects::Texture(int idx)
@@ -2,9 +2,14 @@
 
 struct SDL_Renderer;
 struct SDL_Texture;
-struct SDL_Point;
+struct SDL_Surface;
+class Compositor;
 
+#include "Board.h"
+
+#include <SDL_render.h>
 #include <cassert>
+#include <vector>
 
 #if defined(__unix__)
     #define ASSET_NAME(s) "assets/" s
@@ -19,25 +24,55 @@ public:
 	~Image();
 
 	bool Load(SDL_Renderer* rend, const char* name);
+	bool Load(SDL_Renderer* rend, SDL_Surface* surf);
 	SDL_Texture* Texture() { assert(m_text); return m_text; }
+	bool Valid() const { return m_text != 0; }
 
 private:
 	SDL_Texture* m_text;
 };
 
-const int OBJ_WIDTH = 40;
-const int OBJ_HEIGHT = 40;
-const int OBJ_COUNT = 5;
-
 class Objects
 {
 public:
+	Objects() : m_batch(false), m_compositor(0) { }
+	~Objects();
+
 	bool Load(SDL_Renderer* rend);
-	void DrawTexture(SDL_Renderer* rend, int x, int y, int w, int h, int idx, double scale);
+	// cell is a color index, optionally with special tile flags
+	void DrawTexture(SDL_Renderer* rend, int x, int y, int w, int h, int cell, double scale);
+	void FillRect(SDL_Renderer* rend, const SDL_Rect& rc, const SDL_Color& clr);
+	void DrawRect(SDL_Renderer* rend, const SDL_Rect& rc, const SDL_Color& clr);
+	void Clear(SDL_Renderer* rend, const SDL_Color& clr);
+
+	// Between these calls sprites and fills are queued as atlas quads and
+	// submitted in draw order by a single SDL_RenderGeometry call
+	void BeginBatch();
+	void EndBatch(SDL_Renderer* rend);
+
+	// On the software renderer everything above is drawn on the CPU and only
+	// reaches the renderer here; call before drawing on it directly
+	void Flush();
 
 private:
 	SDL_Texture* Texture(int idx);
 	const SDL_Point& Size(int idx);
 
+	bool BuildAtlas(SDL_Renderer* rend, SDL_Surface* surfs[OBJ_COUNT]);
+	void AddQuad(const SDL_Rect& dest, const SDL_Rect& src, const SDL_Color& clr);
+	void DrawMark(SDL_Renderer* rend, const SDL_Rect& rc, int cell);
+
 	Image m_images[OBJ_COUNT];
+
+	// Gems side by side plus a white patch used for fills
+	Image m_atlas;
+	SDL_Rect m_atlasRects[OBJ_COUNT + 1];
+	int m_atlasWidth, m_atlasHeight;
+
+	bool m_batch;
+	std::vector<SDL_Vertex> m_vertices;
+	std::vector<int> m_indices;
+
+	// Only on the software renderer
+	Compositor* m_compositor;
 };
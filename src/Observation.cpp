@@ -0,0 +1,263 @@
+#include "Observation.h"
+
+#include <cstring>
+#include <new>
+
+static const uint32_t OBS_MAGIC = 0x53424f4d; // "MOBS"
+static const uint32_t OBS_VERSION = 2;
+
+static const int SPECIAL_PLANE_FLAGS[OBS_SPECIAL_PLANES] = { CELL_LINE_H, CELL_LINE_V, CELL_BOMB };
+
+struct ObservationRing::Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotSize;
+	uint32_t slotCount;
+	std::atomic<uint64_t> written;
+};
+
+// Board adapters: operator() gives the color of a cell, Specials its special tile flags
+
+struct CellsBoard
+{
+	const TCells& cells;
+	int operator()(int x, int y) const { return CellColor(cells[x][y]); }
+	int Specials(int x, int y) const { return cells[x][y] == RND_CELL ? 0 : cells[x][y] & CELL_SPECIAL; }
+};
+
+struct BatchBoard
+{
+	const BatchGrid& grid;
+	size_t board;
+	int operator()(int x, int y) const { return CellColor(grid.Cell(board, x, y)); }
+	int Specials(int x, int y) const { return grid.Cell(board, x, y) & CELL_SPECIAL; }
+};
+
+struct SingleBoard
+{
+	const Board& board;
+	int operator()(int x, int y) const { return CellColor(board.Cell(x, y)); }
+	int Specials(int x, int y) const { return board.Cell(x, y) & CELL_SPECIAL; }
+};
+
+template<class TBoard>
+static void Encode(const TBoard& board, uint8_t* obs)
+{
+	memset(obs, 0, OBS_SIZE);
+
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			const int clr = board(x, y);
+			if (clr >= 0 && clr < OBJ_COUNT)
+				obs[(clr * GRID_HEIGHT + y) * GRID_WIDTH + x] = 1;
+
+			const int specials = board.Specials(x, y);
+			for (int i = 0; i < OBS_SPECIAL_PLANES; ++i)
+				if (specials & SPECIAL_PLANE_FLAGS[i])
+					obs[((OBJ_COUNT + i) * GRID_HEIGHT + y) * GRID_WIDTH + x] = 1;
+		}
+	}
+}
+
+// Length of the run through (x, y) along (dx, dy) if the cell had color clr
+template<class TBoard>
+static int RunLength(const TBoard& board, int x, int y, int dx, int dy, int clr, int skipX, int skipY)
+{
+	int len = 1;
+
+	for (int sign = -1; sign <= 1; sign += 2)
+	{
+		int cx = x + sign * dx;
+		int cy = y + sign * dy;
+
+		while (cx >= 0 && cy >= 0 && cx < GRID_WIDTH && cy < GRID_HEIGHT &&
+			   !(cx == skipX && cy == skipY) && board(cx, cy) == clr)
+		{
+			++len;
+			cx += sign * dx;
+			cy += sign * dy;
+		}
+	}
+
+	return len;
+}
+
+template<class TBoard>
+static bool Matches(const TBoard& board, int x, int y, int clr, int fromX, int fromY)
+{
+	return RunLength(board, x, y, 1, 0, clr, fromX, fromY) >= MIN_RANGE ||
+		   RunLength(board, x, y, 0, 1, clr, fromX, fromY) >= MIN_RANGE;
+}
+
+// A swap is legal when either moved cell completes a run at its new place
+template<class TBoard>
+static void LegalMoves(const TBoard& board, uint8_t* mask)
+{
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			for (int down = 0; down < 2; ++down)
+			{
+				const int x2 = down ? x : x + 1;
+				const int y2 = down ? y + 1 : y;
+				const int action = BatchGrid::Action(x, y, down != 0);
+
+				if (x2 >= GRID_WIDTH || y2 >= GRID_HEIGHT)
+				{
+					mask[action] = 0;
+					continue;
+				}
+
+				const int clr1 = board(x, y);
+				const int clr2 = board(x2, y2);
+
+				mask[action] = clr1 != clr2 &&
+							   (Matches(board, x2, y2, clr1, x, y) || Matches(board, x, y, clr2, x2, y2));
+			}
+		}
+	}
+}
+
+void EncodeObservation(const TCells& cells, uint8_t* obs)
+{
+	const CellsBoard board = { cells };
+	Encode(board, obs);
+}
+
+void EncodeObservation(const BatchGrid& grid, size_t board, uint8_t* obs)
+{
+	const BatchBoard b = { grid, board };
+	Encode(b, obs);
+}
+
+void EncodeLegalMoves(const TCells& cells, uint8_t* mask)
+{
+	const CellsBoard board = { cells };
+	LegalMoves(board, mask);
+}
+
+void EncodeLegalMoves(const BatchGrid& grid, size_t board, uint8_t* mask)
+{
+	const BatchBoard b = { grid, board };
+	LegalMoves(b, mask);
+}
+
+void EncodeLegalMoves(const Board& board, uint8_t* mask)
+{
+	const SingleBoard b = { board };
+	LegalMoves(b, mask);
+}
+
+size_t ObservationRing::Size(uint32_t slots)
+{
+	return sizeof(Header) + sizeof(ObsSlot) * slots;
+}
+
+ObservationRing::ObservationRing()
+	: m_header(0)
+	, m_slots(0)
+{
+}
+
+bool ObservationRing::Create(void* mem, size_t size)
+{
+	if (size < Size(1)) return false;
+
+	Header* header = new (mem) Header;
+	header->magic = OBS_MAGIC;
+	header->version = OBS_VERSION;
+	header->slotSize = sizeof(ObsSlot);
+	header->slotCount = uint32_t((size - sizeof(Header)) / sizeof(ObsSlot));
+	header->written.store(0, std::memory_order_relaxed);
+
+	ObsSlot* slots = reinterpret_cast<ObsSlot*>(header + 1);
+	for (uint32_t i = 0; i < header->slotCount; ++i)
+		new (&slots[i].seq) std::atomic<uint64_t>(0);
+
+	m_header = header;
+	m_slots = slots;
+	return true;
+}
+
+bool ObservationRing::Attach(void* mem, size_t size)
+{
+	if (size < Size(1)) return false;
+
+	Header* header = static_cast<Header*>(mem);
+
+	if (header->magic != OBS_MAGIC || header->version != OBS_VERSION ||
+		header->slotSize != sizeof(ObsSlot) || Size(header->slotCount) > size)
+		return false;
+
+	m_header = header;
+	m_slots = reinterpret_cast<ObsSlot*>(header + 1);
+	return true;
+}
+
+ObsSlot* ObservationRing::Begin()
+{
+	const uint64_t n = m_header->written.load(std::memory_order_relaxed);
+	ObsSlot* slot = &m_slots[n % m_header->slotCount];
+
+	slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	return slot;
+}
+
+void ObservationRing::Publish(ObsSlot* slot)
+{
+	const uint64_t n = m_header->written.load(std::memory_order_relaxed);
+
+	slot->seq.store(2 * n + 2, std::memory_order_release);
+	m_header->written.store(n + 1, std::memory_order_release);
+}
+
+void ObservationRing::Write(const TCells& cells, int score)
+{
+	ObsSlot* slot = Begin();
+
+	slot->board = 0;
+	slot->score = score;
+	EncodeObservation(cells, slot->planes);
+	EncodeLegalMoves(cells, slot->legal);
+
+	Publish(slot);
+}
+
+void ObservationRing::Write(const BatchGrid& grid, size_t board)
+{
+	ObsSlot* slot = Begin();
+
+	slot->board = int32_t(board);
+	slot->score = grid.Score(board);
+	EncodeObservation(grid, board, slot->planes);
+	EncodeLegalMoves(grid, board, slot->legal);
+
+	Publish(slot);
+}
+
+uint64_t ObservationRing::Written() const
+{
+	return m_header->written.load(std::memory_order_acquire);
+}
+
+const ObsSlot* ObservationRing::Peek(uint64_t n) const
+{
+	const ObsSlot* slot = &m_slots[n % m_header->slotCount];
+
+	if (slot->seq.load(std::memory_order_acquire) != 2 * n + 2)
+		return 0;
+
+	return slot;
+}
+
+bool ObservationRing::Valid(const ObsSlot* slot, uint64_t n) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot->seq.load(std::memory_order_relaxed) == 2 * n + 2;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+
+#include "Board.h"
+#include "BatchGrid.h"
+
+// One-hot board encoding: OBJ_COUNT color planes followed by OBS_SPECIAL_PLANES
+// planes for line-clear horizontal, line-clear vertical and color bomb tiles,
+// each GRID_HEIGHT rows by GRID_WIDTH columns, one byte per cell. Legal-move
+// masks use the BatchGrid action layout.
+const int OBS_SPECIAL_PLANES = 3;
+const size_t OBS_SIZE = size_t(OBJ_COUNT + OBS_SPECIAL_PLANES) * GRID_HEIGHT * GRID_WIDTH;
+const size_t OBS_MASK_SIZE = BatchGrid::ACTION_COUNT;
+
+void EncodeObservation(const TCells& cells, uint8_t* obs);
+void EncodeObservation(const BatchGrid& grid, size_t board, uint8_t* obs);
+
+void EncodeLegalMoves(const TCells& cells, uint8_t* mask);
+void EncodeLegalMoves(const BatchGrid& grid, size_t board, uint8_t* mask);
+void EncodeLegalMoves(const Board& board, uint8_t* mask);
+
+struct ObsSlot
+{
+	// 2 * n + 1 while observation n is being written, 2 * n + 2 once complete
+	std::atomic<uint64_t> seq;
+	int32_t board;
+	int32_t score;
+	uint8_t planes[OBS_SIZE];
+	uint8_t legal[OBS_MASK_SIZE];
+};
+
+// Single-producer ring of observations laid out in caller-provided memory,
+// typically a MappedFile shared with a consumer process. Encoders write
+// straight into the slots; readers use the slot sequence to detect entries
+// that are not complete yet or were overwritten while being read.
+class ObservationRing
+{
+public:
+	static size_t Size(uint32_t slots);
+
+	ObservationRing();
+
+	// Producer side, formats the memory
+	bool Create(void* mem, size_t size);
+	// Consumer side, validates a ring made by Create
+	bool Attach(void* mem, size_t size);
+
+	void Write(const TCells& cells, int score);
+	void Write(const BatchGrid& grid, size_t board);
+
+	// Number of observations published so far
+	uint64_t Written() const;
+
+	// Returns observation n, or 0 when it is not written yet or already overwritten.
+	// The slot is read in place; call Valid afterwards to make sure it was not
+	// overwritten while in use.
+	const ObsSlot* Peek(uint64_t n) const;
+	bool Valid(const ObsSlot* slot, uint64_t n) const;
+
+private:
+	struct Header;
+
+	ObsSlot* Begin();
+	void Publish(ObsSlot* slot);
+
+	Header* m_header;
+	ObsSlot* m_slots;
+};
@@ -0,0 +1,204 @@
+#include "Particles.h"
+#include "Objects.h"
+#include "Stats.h"
+
+#include <SDL.h>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define PARTICLES_SSE
+#endif
+
+static const float GRAVITY = 900.0f;	// px / s^2
+static const float SPEED = 260.0f;		// px / s
+static const float LIFE = 0.6f;			// s
+static const float SIZE = 5.0f;			// px
+
+static const SDL_Color OBJ_COLORS[OBJ_COUNT] =
+{
+	{  80, 140, 255, 255 },	// Blue
+	{  80, 230, 110, 255 },	// Green
+	{ 200,  90, 255, 255 },	// Purple
+	{ 255,  80,  70, 255 },	// Red
+	{ 255, 220,  60, 255 }	// Yellow
+};
+
+Particles::Particles()
+	: m_count(0)
+	, m_x(MAX_PARTICLES)
+	, m_y(MAX_PARTICLES)
+	, m_vx(MAX_PARTICLES)
+	, m_vy(MAX_PARTICLES)
+	, m_life(MAX_PARTICLES)
+	, m_color(MAX_PARTICLES)
+	, m_vertices(MAX_PARTICLES * 4)
+	, m_indices(MAX_PARTICLES * 6)
+	, m_rng(0x2545f491)
+	, m_lastTS(SDL_GetTicks())
+{
+	for (int i = 0; i < MAX_PARTICLES; ++i)
+	{
+		const int v = i * 4;
+		int* idx = &m_indices[size_t(i) * 6];
+		idx[0] = v; idx[1] = v + 1; idx[2] = v + 2;
+		idx[3] = v; idx[4] = v + 2; idx[5] = v + 3;
+	}
+
+	m_pending.reserve(256);
+}
+
+void Particles::Burst(const SDL_Rect& rc, int clr, int count, Uint32 delay)
+{
+	if (clr < 0 || clr >= OBJ_COUNT || count <= 0) return;
+
+	const Pending p = { rc, clr, count, SDL_GetTicks() + delay };
+	m_pending.push_back(p);
+}
+
+void Particles::Clear()
+{
+	m_count = 0;
+	m_pending.clear();
+}
+
+void Particles::Update()
+{
+	const Uint32 ts = SDL_GetTicks();
+	const float dt = std::min(float(ts - m_lastTS) / 1000.0f, 0.1f);
+	m_lastTS = ts;
+
+	size_t i = 0;
+	while (i < m_pending.size())
+	{
+		if (int(ts - m_pending[i].startTS) >= 0)
+		{
+			Spawn(m_pending[i]);
+			m_pending[i] = m_pending.back();
+			m_pending.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	if (m_count)
+	{
+		Advance(dt);
+		Compact();
+	}
+}
+
+void Particles::Spawn(const Pending& p)
+{
+	const int count = std::min(p.count, MAX_PARTICLES - m_count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		const size_t n = size_t(m_count++);
+
+		m_rng = m_rng * 1664525u + 1013904223u;
+		const float rx = float(m_rng >> 16) / 65536.0f;
+		m_rng = m_rng * 1664525u + 1013904223u;
+		const float ry = float(m_rng >> 16) / 65536.0f;
+
+		m_x[n] = float(p.rc.x) + rx * float(p.rc.w);
+		m_y[n] = float(p.rc.y) + ry * float(p.rc.h);
+		m_vx[n] = (rx - 0.5f) * 2 * SPEED;
+		m_vy[n] = -ry * SPEED;
+		m_life[n] = LIFE * (0.5f + 0.5f * ry);
+		m_color[n] = OBJ_COLORS[p.clr];
+	}
+}
+
+// Integrates all particles; the SoA layout lets four of them go per SSE op
+void Particles::Advance(float dt)
+{
+	float* x = &m_x[0];
+	float* y = &m_y[0];
+	float* vx = &m_vx[0];
+	float* vy = &m_vy[0];
+	float* life = &m_life[0];
+	const int n = m_count;
+	int i = 0;
+
+#ifdef PARTICLES_SSE
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 vg = _mm_set1_ps(GRAVITY * dt);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m128 pvx = _mm_loadu_ps(vx + i);
+		const __m128 pvy = _mm_add_ps(_mm_loadu_ps(vy + i), vg);
+
+		_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(pvx, vdt)));
+		_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(pvy, vdt)));
+		_mm_storeu_ps(vy + i, pvy);
+		_mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), vdt));
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		vy[i] += GRAVITY * dt;
+		x[i] += vx[i] * dt;
+		y[i] += vy[i] * dt;
+		life[i] -= dt;
+	}
+}
+
+// Moves the last live particle into every dead slot
+void Particles::Compact()
+{
+	int i = 0;
+
+	while (i < m_count)
+	{
+		if (m_life[i] > 0)
+		{
+			++i;
+			continue;
+		}
+
+		const int last = --m_count;
+		m_x[i] = m_x[last];
+		m_y[i] = m_y[last];
+		m_vx[i] = m_vx[last];
+		m_vy[i] = m_vy[last];
+		m_life[i] = m_life[last];
+		m_color[i] = m_color[last];
+	}
+}
+
+void Particles::Draw(SDL_Renderer* rend)
+{
+	if (!m_count) return;
+
+	SDL_Vertex* v = &m_vertices[0];
+
+	for (int i = 0; i < m_count; ++i, v += 4)
+	{
+		const float k = std::min(m_life[i] / LIFE, 1.0f);
+		const float h = SIZE * (0.5f + k) * 0.5f;
+		SDL_Color c = m_color[i];
+		c.a = Uint8(255 * k);
+
+		v[0].position.x = m_x[i] - h; v[0].position.y = m_y[i] - h;
+		v[1].position.x = m_x[i] + h; v[1].position.y = m_y[i] - h;
+		v[2].position.x = m_x[i] + h; v[2].position.y = m_y[i] + h;
+		v[3].position.x = m_x[i] - h; v[3].position.y = m_y[i] + h;
+
+		for (int j = 0; j < 4; ++j)
+		{
+			v[j].color = c;
+			v[j].tex_coord.x = 0;
+			v[j].tex_coord.y = 0;
+		}
+	}
+
+	SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_BLEND);
+	SDL_RenderGeometry(rend, NULL, &m_vertices[0], m_count * 4, &m_indices[0], m_count * 6);
+	SDL_SetRenderDrawBlendMode(rend, SDL_BLENDMODE_NONE);
+	DrawCounter::Add();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <SDL_rect.h>
+#include <SDL_render.h>
+#include <vector>
+
+// Spark bursts for matched ranges. Particles live in structure-of-arrays
+// buffers allocated once, are advanced with SIMD and drawn with a single
+// SDL_RenderGeometry call.
+class Particles
+{
+public:
+	static const int MAX_PARTICLES = 65536;
+	static const int PER_CELL = 24;
+
+	Particles();
+
+	// Spawns count particles over rc after delay ms
+	void Burst(const SDL_Rect& rc, int clr, int count, Uint32 delay);
+
+	void Update();
+	void Draw(SDL_Renderer* rend);
+
+	bool Active() const { return m_count > 0 || !m_pending.empty(); }
+	int Count() const { return m_count; }
+
+	void Clear();
+
+private:
+	struct Pending
+	{
+		SDL_Rect rc;
+		int clr;
+		int count;
+		Uint32 startTS;
+	};
+
+	void Spawn(const Pending& p);
+	void Advance(float dt);
+	void Compact();
+
+	int m_count;
+	std::vector<float> m_x, m_y, m_vx, m_vy, m_life;
+	std::vector<SDL_Color> m_color;
+	std::vector<Pending> m_pending;
+	std::vector<SDL_Vertex> m_vertices;
+	std::vector<int> m_indices;
+	Uint32 m_rng;
+	Uint32 m_lastTS;
+};
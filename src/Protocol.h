@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Board.h"
+
+// Fixed-size messages of the session server (midas_server), host byte order,
+// exchanged over a local stream socket. Every request gets exactly one reply
+// in order; OP_END replies are pushed unsolicited when a session's time is up.
+
+enum ServerOp
+{
+	OP_NEW = 1,		// seed, 0 lets the server choose
+	OP_SWAP,		// x1, y1, x2, y2
+	OP_STATE,
+	OP_CLOSE,
+	OP_END
+};
+
+enum ServerStatus
+{
+	ST_OK,
+	ST_REJECTED,	// swap did not match
+	ST_NO_SESSION,
+	ST_EXPIRED,
+	ST_FULL,
+	ST_BAD_REQUEST
+};
+
+#pragma pack(push, 1)
+
+struct Request
+{
+	uint8_t op;
+	uint8_t x1, y1, x2, y2;
+	uint8_t reserved[3];
+	uint32_t session;
+	uint32_t seed;
+};
+
+struct Reply
+{
+	uint8_t op;
+	uint8_t status;
+	uint8_t cascades;
+	uint8_t reserved;
+	uint32_t session;
+	int32_t score;
+	uint32_t timeLeft;	// ms
+	uint8_t cells[GRID_WIDTH][GRID_HEIGHT];	// color and special tile flags, see Board.h
+};
+
+#pragma pack(pop)
@@ -0,0 +1,139 @@
+#include "PuzzlePack.h"
+
+#include <cstring>
+
+static const uint32_t PUZZLE_MAGIC = 0x4c5a504d; // "MPZL"
+static const uint32_t PUZZLE_VERSION = 1;
+static const unsigned PUZZLE_CELL_MASK = (1u << PUZZLE_BITS) - 1;
+
+static_assert((1 << PUZZLE_BITS) >= OBJ_COUNT, "cell colors must fit PUZZLE_BITS");
+
+PuzzlePack::PuzzlePack()
+	: m_header(0)
+	, m_data(0)
+	, m_index(0)
+{
+}
+
+bool PuzzlePack::Create(const char* path, uint32_t count)
+{
+	const uint64_t dataOffset = sizeof(PuzzleHeader);
+	const uint64_t indexOffset = dataOffset + uint64_t(count) * PUZZLE_BOARD_SIZE;
+	const uint64_t size = indexOffset + uint64_t(count) * sizeof(PuzzleEntry);
+
+	if (!m_file.Open(path, size_t(size), true)) return false;
+
+	m_header = static_cast<PuzzleHeader*>(m_file.Data());
+	memset(m_header, 0, sizeof(PuzzleHeader));
+	m_header->magic = PUZZLE_MAGIC;
+	m_header->version = PUZZLE_VERSION;
+	m_header->count = count;
+	m_header->gridWidth = GRID_WIDTH;
+	m_header->gridHeight = GRID_HEIGHT;
+	m_header->bitsPerCell = PUZZLE_BITS;
+	m_header->dataOffset = dataOffset;
+	m_header->indexOffset = indexOffset;
+
+	m_data = static_cast<uint8_t*>(m_file.Data()) + dataOffset;
+	m_index = reinterpret_cast<PuzzleEntry*>(static_cast<uint8_t*>(m_file.Data()) + indexOffset);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		m_index[i].board = i;
+		m_index[i].moves = 0;
+		m_index[i].difficulty = PUZZLE_UNRATED;
+	}
+
+	return true;
+}
+
+bool PuzzlePack::Open(const char* path)
+{
+	m_header = 0;
+
+	if (!m_file.Open(path, 0, false) || m_file.Size() < sizeof(PuzzleHeader)) return false;
+
+	PuzzleHeader* header = static_cast<PuzzleHeader*>(m_file.Data());
+
+	if (header->magic != PUZZLE_MAGIC || header->version != PUZZLE_VERSION ||
+		header->gridWidth != GRID_WIDTH || header->gridHeight != GRID_HEIGHT ||
+		header->bitsPerCell != PUZZLE_BITS)
+		return false;
+
+	if (header->dataOffset + uint64_t(header->count) * PUZZLE_BOARD_SIZE > header->indexOffset ||
+		header->indexOffset + uint64_t(header->count) * sizeof(PuzzleEntry) > m_file.Size())
+		return false;
+
+	m_data = static_cast<uint8_t*>(m_file.Data()) + header->dataOffset;
+	m_index = reinterpret_cast<PuzzleEntry*>(static_cast<uint8_t*>(m_file.Data()) + header->indexOffset);
+
+	// Packed() trusts the index, so its entries are checked once here
+	for (uint32_t i = 0; i < header->count; ++i)
+		if (m_index[i].board >= header->count)
+			return false;
+
+	m_header = header;
+	return true;
+}
+
+const uint8_t* PuzzlePack::Packed(size_t idx) const
+{
+	return m_data + size_t(m_index[idx].board) * PUZZLE_BOARD_SIZE;
+}
+
+// Cell k occupies bits [k * PUZZLE_BITS, (k + 1) * PUZZLE_BITS) of the little-endian bit string
+
+template<class TCell, int W, int H>
+static void Unpack(const uint8_t* p, TCell (&cells)[W][H])
+{
+	for (int k = 0; k < GRID_CELLS; ++k)
+	{
+		const int bit = k * PUZZLE_BITS;
+		const int shift = bit % 8;
+		unsigned v = unsigned(p[bit / 8]) >> shift;
+
+		if (shift > 8 - PUZZLE_BITS)
+			v |= unsigned(p[bit / 8 + 1]) << (8 - shift);
+
+		cells[k / GRID_HEIGHT][k % GRID_HEIGHT] = TCell(v & PUZZLE_CELL_MASK);
+	}
+}
+
+// Packed cells have room for more values than there are colors
+template<class TCell, int W, int H>
+static bool ValidColors(const TCell (&cells)[W][H])
+{
+	for (int x = 0; x < W; ++x)
+		for (int y = 0; y < H; ++y)
+			if (cells[x][y] >= OBJ_COUNT)
+				return false;
+
+	return true;
+}
+
+bool PuzzlePack::Decode(size_t idx, TCells& cells) const
+{
+	Unpack(Packed(idx), cells);
+	return ValidColors(cells);
+}
+
+bool PuzzlePack::Decode(size_t idx, TBoardCells& cells) const
+{
+	Unpack(Packed(idx), cells);
+	return ValidColors(cells);
+}
+
+void PuzzlePack::Encode(uint32_t board, const TBoardCells& cells)
+{
+	uint8_t* p = m_data + size_t(board) * PUZZLE_BOARD_SIZE;
+	memset(p, 0, PUZZLE_BOARD_SIZE);
+
+	for (int k = 0; k < GRID_CELLS; ++k)
+	{
+		const int bit = k * PUZZLE_BITS;
+		const unsigned v = (cells[k / GRID_HEIGHT][k % GRID_HEIGHT] & PUZZLE_CELL_MASK) << (bit % 8);
+
+		p[bit / 8] |= uint8_t(v);
+		if (v >> 8) p[bit / 8 + 1] |= uint8_t(v >> 8);
+	}
+}
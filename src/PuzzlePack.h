@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "Board.h"
+#include "MappedFile.h"
+
+// Puzzle pack file: header, boards packed at PUZZLE_BITS per cell in
+// x-major order, then an index of entries, ordered by difficulty once rated.
+// The file is memory-mapped and boards are unpacked straight from the mapping.
+
+const int PUZZLE_BITS = 3;
+const size_t PUZZLE_BOARD_SIZE = (GRID_CELLS * PUZZLE_BITS + 7) / 8;
+const uint16_t PUZZLE_UNRATED = 0xffff;
+
+#pragma pack(push, 1)
+
+struct PuzzleHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint8_t gridWidth;
+	uint8_t gridHeight;
+	uint8_t bitsPerCell;
+	uint8_t reserved;
+	uint64_t dataOffset;
+	uint64_t indexOffset;
+};
+
+struct PuzzleEntry
+{
+	uint32_t board;			// position in the data block
+	uint16_t moves;			// legal first moves
+	uint16_t difficulty;	// 0 (easy) .. 1000 (no way out), PUZZLE_UNRATED
+};
+
+#pragma pack(pop)
+
+class PuzzlePack
+{
+public:
+	PuzzlePack();
+
+	bool Create(const char* path, uint32_t count);
+	bool Open(const char* path);
+
+	uint32_t Count() const { return m_header ? m_header->count : 0; }
+
+	PuzzleEntry& Entry(size_t idx) { return m_index[idx]; }
+	const PuzzleEntry& Entry(size_t idx) const { return m_index[idx]; }
+
+	// Board of the idx-th index entry; false when it holds a color of
+	// OBJ_COUNT or more. Boards are only checked here, Open does not parse them.
+	bool Decode(size_t idx, TCells& cells) const;
+	bool Decode(size_t idx, TBoardCells& cells) const;
+
+	// Stores a board at data position board
+	void Encode(uint32_t board, const TBoardCells& cells);
+
+	void Flush() { m_file.Flush(false); }
+
+private:
+	const uint8_t* Packed(size_t idx) const;
+
+	MappedFile m_file;
+	PuzzleHeader* m_header;
+	uint8_t* m_data;
+	PuzzleEntry* m_index;
+};
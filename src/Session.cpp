@@ -0,0 +1,112 @@
+#include "Session.h"
+
+#include <cstring>
+
+static const uint32_t SESSION_MAGIC = 0x5353454d; // "MESS"
+static const uint32_t SESSION_VERSION = 1;
+
+// FNV-1a over the state between the sequence and the checksum
+static uint32_t Checksum(const SessionSlot& slot)
+{
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(&slot);
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = offsetof(SessionSlot, grid); i < offsetof(SessionSlot, checksum); ++i)
+		hash = (hash ^ p[i]) * 16777619u;
+
+	return hash;
+}
+
+// The checksum only catches torn writes; a file edited or written by another
+// build must not hand Grid::Restore cells or a selection it cannot draw
+static bool ValidGrid(const GridSnapshot& grid)
+{
+	for (int x = 0; x < GRID_WIDTH; ++x)
+	{
+		for (int y = 0; y < GRID_HEIGHT; ++y)
+		{
+			const int cell = grid.cells[x][y];
+			if (CellColor(cell) >= OBJ_COUNT || (cell & ~(CELL_COLOR_MASK | CELL_SPECIAL)))
+				return false;
+		}
+	}
+
+	if (grid.selX == -1 && grid.selY == -1) return true;
+
+	return grid.selX >= 0 && grid.selX < GRID_WIDTH && grid.selY >= 0 && grid.selY < GRID_HEIGHT;
+}
+
+static bool Intact(const SessionSlot& slot)
+{
+	return slot.seq && !(slot.seq & 1) && slot.timeLeft <= GAME_LEN && slot.checksum == Checksum(slot) &&
+		ValidGrid(slot.grid);
+}
+
+SessionFile::SessionFile()
+	: m_header(0)
+	, m_seq(0)
+{
+}
+
+bool SessionFile::Open(const char* path)
+{
+	if (!m_file.Open(path, sizeof(SessionHeader), true))
+		return false;
+
+	m_header = static_cast<SessionHeader*>(m_file.Data());
+
+	if (m_header->magic != SESSION_MAGIC || m_header->version != SESSION_VERSION)
+	{
+		memset(m_header, 0, sizeof(*m_header));
+		m_header->magic = SESSION_MAGIC;
+		m_header->version = SESSION_VERSION;
+	}
+
+	for (int i = 0; i < 2; ++i)
+		if (Intact(m_header->slots[i]) && m_header->slots[i].seq > m_seq)
+			m_seq = m_header->slots[i].seq;
+
+	return true;
+}
+
+void SessionFile::Save(const GridSnapshot& grid, uint32_t timeLeft)
+{
+	if (!m_header) return;
+
+	// Overwrite the older slot, the newer one stays valid meanwhile
+	m_seq += 2;
+	SessionSlot& slot = m_header->slots[(m_seq / 2) & 1];
+
+	slot.seq = m_seq - 1;
+	memset(&slot.grid, 0, sizeof(slot.grid));	// padding too, for the checksum
+	slot.grid.score = grid.score;
+	slot.grid.rng = grid.rng;
+	slot.grid.selX = grid.selX;
+	slot.grid.selY = grid.selY;
+	memcpy(slot.grid.cells, grid.cells, sizeof(slot.grid.cells));
+	slot.timeLeft = timeLeft;
+	slot.checksum = Checksum(slot);
+	slot.seq = m_seq;
+
+	m_file.Flush(true);
+}
+
+bool SessionFile::Load(GridSnapshot& grid, uint32_t& timeLeft) const
+{
+	if (!m_header) return false;
+
+	const SessionSlot* best = 0;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		const SessionSlot& slot = m_header->slots[i];
+		if (Intact(slot) && (!best || slot.seq > best->seq))
+			best = &slot;
+	}
+
+	if (!best) return false;
+
+	grid = best->grid;
+	timeLeft = best->timeLeft;
+	return true;
+}
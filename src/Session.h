@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "Grid.h"
+#include "MappedFile.h"
+
+struct SessionSlot
+{
+	uint64_t seq;		// odd while being written
+	GridSnapshot grid;
+	uint32_t timeLeft;	// ms of GAME_LEN
+	uint32_t checksum;	// of grid and timeLeft
+};
+
+struct SessionHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	SessionSlot slots[2];
+};
+
+// Live game state in a small memory-mapped file, so a restarted process picks
+// up the board, score, RNG and game time where the previous one died. Saves
+// alternate between two slots; a write torn by a crash leaves the other slot
+// intact and is rejected by its sequence and checksum. Slots whose cells or
+// selection are out of range are rejected as well.
+class SessionFile
+{
+public:
+	SessionFile();
+
+	bool Open(const char* path);
+
+	// Call after every move and on a timer, cheap enough for the input path
+	void Save(const GridSnapshot& grid, uint32_t timeLeft);
+	// Latest intact state, false when there is none
+	bool Load(GridSnapshot& grid, uint32_t& timeLeft) const;
+
+private:
+	MappedFile m_file;
+	SessionHeader* m_header;
+	uint64_t m_seq;
+};
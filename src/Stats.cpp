@@ -0,0 +1,35 @@
+#include "Stats.h"
+
+#include <algorithm>
+
+unsigned DrawCounter::s_count = 0;
+
+unsigned DrawCounter::Take()
+{
+	const unsigned count = s_count;
+	s_count = 0;
+	return count;
+}
+
+double Percentiles::Get(double pc)
+{
+	if (m_values.empty()) return 0;
+
+	size_t rank = size_t(pc / 100 * double(m_values.size()) + 0.5);
+	if (rank > 0) --rank;
+	rank = std::min(rank, m_values.size() - 1);
+
+	std::nth_element(m_values.begin(), m_values.begin() + ptrdiff_t(rank), m_values.end());
+	return m_values[rank];
+}
+
+double Percentiles::Mean() const
+{
+	if (m_values.empty()) return 0;
+
+	double sum = 0;
+	for (size_t i = 0; i < m_values.size(); ++i)
+		sum += m_values[i];
+
+	return sum / double(m_values.size());
+}
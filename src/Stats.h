@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+class Percentiles
+{
+public:
+	void Add(double value) { m_values.push_back(value); }
+	void Clear() { m_values.clear(); }
+	void Reserve(size_t count) { m_values.reserve(count); }
+
+	size_t Count() const { return m_values.size(); }
+	bool Empty() const { return m_values.empty(); }
+
+	// pc is in [0, 100], nearest-rank
+	double Get(double pc);
+	double Mean() const;
+
+private:
+	std::vector<double> m_values;
+};
+
+// Counts renderer submissions (copies, fills, outlines) made by the drawing code
+class DrawCounter
+{
+public:
+	static void Add() { ++s_count; }
+
+	// Returns the count since the previous call
+	static unsigned Take();
+
+private:
+	static unsigned s_count;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+// Fixed-size stack of the last N states; pushing onto a full ring drops the oldest
+template <typename T, size_t N>
+class UndoRing
+{
+public:
+	UndoRing() : m_top(0), m_count(0) { }
+
+	void Push(const T& item)
+	{
+		m_items[m_top] = item;
+		m_top = (m_top + 1) % N;
+		if (m_count < N) ++m_count;
+	}
+
+	bool Pop(T& item)
+	{
+		if (!m_count) return false;
+
+		m_top = (m_top + N - 1) % N;
+		--m_count;
+		item = m_items[m_top];
+		return true;
+	}
+
+	size_t Size() const { return m_count; }
+	bool Empty() const { return m_count == 0; }
+	void Clear() { m_top = m_count = 0; }
+
+private:
+	T m_items[N];
+	size_t m_top;
+	size_t m_count;
+};
@@ -0,0 +1,132 @@
+#include "Wall.h"
+#include "Animations.h"
+#include "Grid.h"
+#include "Objects.h"
+#include "Observation.h"
+
+#include <SDL.h>
+#include <algorithm>
+#include <cmath>
+
+static const int BOARD_GAP = 2;
+static const Uint32 MIN_THINK = 300;
+static const Uint32 MAX_THINK = 1500;
+
+Wall::Wall(SDL_Renderer* rend, Objects& obj, int count, const SDL_Rect& pos)
+	: m_rend(rend)
+	, m_objects(obj)
+	, m_rng(SeedRandom(SDL_GetTicks()))
+{
+	const SDL_Rect empty = { 0, 0, 0, 0 };
+
+	m_boards.resize(size_t(count));
+
+	for (size_t i = 0; i < m_boards.size(); ++i)
+	{
+		m_boards[i].anim = new Animations;
+		m_boards[i].grid = new Grid(rend, obj, *m_boards[i].anim, empty);
+		m_boards[i].nextMoveTS = 0;
+	}
+
+	Move(pos);
+}
+
+Wall::~Wall()
+{
+	for (size_t i = 0; i < m_boards.size(); ++i)
+	{
+		delete m_boards[i].grid;
+		delete m_boards[i].anim;
+	}
+}
+
+void Wall::Move(const SDL_Rect& pos)
+{
+	const int count = int(m_boards.size());
+	if (!count) return;
+
+	const int cols = int(ceil(sqrt(double(count))));
+	const int rows = (count + cols - 1) / cols;
+	const int side = std::min(pos.w / cols, pos.h / rows);
+	const int x0 = pos.x + (pos.w - side * cols) / 2;
+	const int y0 = pos.y + (pos.h - side * rows) / 2;
+
+	for (int i = 0; i < count; ++i)
+	{
+		// Cancelled animations were laid out for the old rect
+		m_boards[size_t(i)].anim->Cancel();
+
+		const SDL_Rect rc = { x0 + (i % cols) * side + BOARD_GAP / 2, y0 + (i / cols) * side + BOARD_GAP / 2,
+							  side - BOARD_GAP, side - BOARD_GAP };
+		m_boards[size_t(i)].grid->Move(rc, false);
+	}
+}
+
+void Wall::SetQuality(Quality quality)
+{
+	for (size_t i = 0; i < m_boards.size(); ++i)
+		m_boards[i].grid->SetQuality(quality);
+}
+
+void Wall::PlayMove(Board& board, Uint32 ts)
+{
+	uint8_t legal[OBS_MASK_SIZE];
+	EncodeLegalMoves(board.grid->Cells(), legal);
+
+	int count = 0;
+	for (size_t i = 0; i < OBS_MASK_SIZE; ++i)
+		count += legal[i];
+
+	if (!count)
+	{
+		board.grid->NewGame();
+		return;
+	}
+
+	int pick = int(NextRandom(m_rng) % unsigned(count));
+	size_t action = 0;
+	while (!legal[action] || pick--)
+		++action;
+
+	const int cell = int(action / 2);
+	const int x = cell / GRID_HEIGHT;
+	const int y = cell % GRID_HEIGHT;
+	const bool down = (action & 1) != 0;
+
+	board.grid->Select(x, y);
+	board.grid->Swap(x + !down, y + down);
+
+	// The cascade length is known as soon as the move is played
+	board.nextMoveTS = ts + board.anim->Duration() + MIN_THINK + NextRandom(m_rng) % (MAX_THINK - MIN_THINK);
+}
+
+void Wall::Draw()
+{
+	const Uint32 ts = SDL_GetTicks();
+
+	// Bot moves redraw their boards, so they also go into the batch
+	m_objects.BeginBatch();
+
+	for (size_t i = 0; i < m_boards.size(); ++i)
+	{
+		Board& board = m_boards[i];
+
+		if (!board.anim->Active() && int(ts - board.nextMoveTS) >= 0)
+			PlayMove(board, ts);
+
+		if (board.anim->Active())
+		{
+			board.grid->RedrawOld();
+			board.anim->Draw(m_rend);
+
+			if (!board.anim->Active())
+				board.grid->Redraw();
+		}
+		else
+		{
+			board.grid->Redraw();
+		}
+	}
+
+	m_objects.EndBatch(m_rend);
+}
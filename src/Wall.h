@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SDL_rect.h>
+#include <vector>
+
+#include "Governor.h"
+
+class Objects;
+class Grid;
+class Animations;
+struct SDL_Renderer;
+
+// Spectator view: many bot-played boards tiled over one rect. Every board
+// and its animations go through the Objects batch, so a frame costs one
+// draw call regardless of the board count.
+class Wall
+{
+public:
+	Wall(SDL_Renderer* rend, Objects& obj, int count, const SDL_Rect& pos);
+	~Wall();
+
+	void Move(const SDL_Rect& pos);
+	void SetQuality(Quality quality);
+
+	// Plays due bot moves and draws all boards
+	void Draw();
+
+private:
+	struct Board
+	{
+		Animations* anim;
+		Grid* grid;
+		Uint32 nextMoveTS;
+	};
+
+	void PlayMove(Board& board, Uint32 ts);
+
+	SDL_Renderer* m_rend;
+	Objects& m_objects;
+	std::vector<Board> m_boards;
+	Uint32 m_rng;
+};